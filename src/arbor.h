@@ -0,0 +1,190 @@
+#ifndef ARBOR_
+#define ARBOR_
+
+#include "biodynamo.h"
+#include "extended_objects.h"
+
+namespace bdm {
+  using namespace std;
+
+  // Flattened dendritic arbor of one cell, built on demand by a single walk
+  // through the resource manager. Node 0 is the soma; every other node is the
+  // distal end of a neurite element (GetPosition() of an element is its
+  // midpoint), with the length of that element. Nodes are in depth-first
+  // order, so a parent index is always lower than its child index: metrics
+  // are linear scans over contiguous arrays, forward for top-down and
+  // backward for bottom-up quantities.
+  struct Arbor {
+    int cell_type = -1;
+    int subtype = -1;
+    SoUid uid;
+    vector<int32_t> parent;
+    vector<float> x, y, z;
+    vector<float> diameter;
+    // length of the element ending at each node, 0 for the soma
+    vector<float> length;
+
+    size_t size() const { return parent.size(); }
+
+    void Add(int32_t parent_index, const Double3& position, double diam,
+             double element_length = 0) {
+      parent.push_back(parent_index);
+      x.push_back(position[0]);
+      y.push_back(position[1]);
+      z.push_back(position[2]);
+      diameter.push_back(diam);
+      length.push_back(element_length);
+    }
+
+    // number of children of each node
+    vector<int32_t> ChildCount() const {
+      vector<int32_t> children(size(), 0);
+      for (size_t i = 1; i < size(); i++) {
+        children[parent[i]]++;
+      }
+      return children;
+    }
+
+    // cumulated length of all neurite elements; primary elements start at
+    // the soma surface, not at its centre
+    double TotalLength() const {
+      double total = 0;
+      for (size_t i = 1; i < size(); i++) {
+        total += length[i];
+      }
+      return total;
+    }
+
+    // neurite nodes with more than one child (soma excluded)
+    int BranchPoints() const {
+      auto children = ChildCount();
+      int branch_points = 0;
+      for (size_t i = 1; i < size(); i++) {
+        branch_points += children[i] > 1;
+      }
+      return branch_points;
+    }
+
+    int Terminals() const {
+      auto children = ChildCount();
+      int terminals = 0;
+      for (size_t i = 1; i < size(); i++) {
+        terminals += children[i] == 0;
+      }
+      return terminals;
+    }
+
+    // area of the x-y convex hull of all nodes (monotone chain)
+    double FieldArea() const {
+      vector<pair<float, float>> points(size());
+      for (size_t i = 0; i < size(); i++) {
+        points[i] = {x[i], y[i]};
+      }
+      sort(points.begin(), points.end());
+      points.erase(unique(points.begin(), points.end()), points.end());
+      if (points.size() < 3) { return 0; }
+      auto cross = [](const pair<float, float>& o, const pair<float, float>& a,
+                      const pair<float, float>& b) {
+        return (double)(a.first - o.first) * (b.second - o.second) -
+               (double)(a.second - o.second) * (b.first - o.first);
+      };
+      vector<pair<float, float>> hull(2 * points.size());
+      size_t k = 0;
+      for (size_t i = 0; i < points.size(); i++) {
+        while (k >= 2 && cross(hull[k-2], hull[k-1], points[i]) <= 0) { k--; }
+        hull[k++] = points[i];
+      }
+      for (size_t i = points.size() - 1, t = k + 1; i > 0; i--) {
+        while (k >= t && cross(hull[k-2], hull[k-1], points[i-1]) <= 0) { k--; }
+        hull[k++] = points[i-1];
+      }
+      double area = 0;
+      for (size_t i = 0; i + 1 < k; i++) {
+        area += (double)hull[i].first * hull[i+1].second -
+                (double)hull[i+1].first * hull[i].second;
+      }
+      return fabs(area) / 2;
+    }
+
+    // Strahler order of every node: terminals are 1, a neurite node takes
+    // the highest order of its children, plus one if two children share it.
+    // The soma is not a bifurcation (as in BranchPoints): it takes the
+    // highest order of its primary dendrites
+    vector<int32_t> StrahlerOrders() const {
+      vector<int32_t> order(size(), 1);
+      vector<int32_t> max_order(size(), 0);
+      vector<int32_t> max_count(size(), 0);
+      for (size_t i = size(); i-- > 1;) {
+        if (max_order[i] != 0) {
+          order[i] = max_order[i] + (max_count[i] > 1);
+        }
+        int32_t p = parent[i];
+        if (order[i] > max_order[p]) {
+          max_order[p] = order[i];
+          max_count[p] = 1;
+        } else if (order[i] == max_order[p]) {
+          max_count[p]++;
+        }
+      }
+      if (size() != 0 && max_order[0] != 0) {
+        order[0] = max_order[0];
+      }
+      return order;
+    }
+
+    int StrahlerOrder() const {
+      return size() < 2 ? 0 : StrahlerOrders()[0];
+    }
+  };  // end Arbor
+
+
+  inline Arbor BuildArbor(MyCell* cell) {
+    Arbor arbor;
+    arbor.cell_type = cell->GetCellType();
+    arbor.uid = cell->GetUid();
+    arbor.Add(-1, cell->GetPosition(), cell->GetDiameter());
+
+    // explicit stack instead of recursion: (element, parent node)
+    vector<pair<MyNeurite*, int32_t>> stack;
+    auto& daughters = cell->GetDaughters();
+    for (auto it = daughters.rbegin(); it != daughters.rend(); ++it) {
+      stack.push_back({static_cast<MyNeurite*>(&**it), 0});
+    }
+    while (!stack.empty()) {
+      auto* ne = stack.back().first;
+      int32_t parent = stack.back().second;
+      stack.pop_back();
+      int32_t node = arbor.size();
+      arbor.Add(parent, ne->GetDistalEnd(), ne->GetDiameter(), ne->GetLength());
+      arbor.subtype = ne->GetSubtype();
+      if (ne->GetDaughterRight() != nullptr) {
+        stack.push_back({static_cast<MyNeurite*>(&*ne->GetDaughterRight()),
+                         node});
+      }
+      if (ne->GetDaughterLeft() != nullptr) {
+        stack.push_back({static_cast<MyNeurite*>(&*ne->GetDaughterLeft()),
+                         node});
+      }
+    }
+    return arbor;
+  }  // end BuildArbor
+
+
+  // swc export, positions relative to the soma
+  inline void WriteArborSwc(const Arbor& arbor, const string& file_name) {
+    ofstream swc_file(file_name);
+    auto children = arbor.ChildCount();
+    swc_file << "1 1 0 0 0 " << arbor.diameter[0] / 2 << " -1";
+    for (size_t i = 1; i < arbor.size(); i++) {
+      // 6: ending point, 3: dendrite
+      swc_file << "\n" << i + 1 << (children[i] == 0 ? " 6 " : " 3 ")
+               << arbor.x[i] - arbor.x[0] << " " << arbor.y[i] - arbor.y[0]
+               << " " << arbor.z[i] - arbor.z[0] << " "
+               << arbor.diameter[i] / 2 << " " << arbor.parent[i] + 1;
+    }
+    swc_file.close();
+  }  // end WriteArborSwc
+
+}  // namespace bdm
+
+#endif
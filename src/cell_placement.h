@@ -0,0 +1,53 @@
+#ifndef CELL_PLACEMENT_
+#define CELL_PLACEMENT_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace bdm {
+
+  // initial positions and diameters of the cells created by CellCreator
+  struct CellPlacement {
+    std::vector<std::array<double, 3>> positions;
+    std::vector<double> diameters;
+  };
+
+  // draw num_cells cells between min and max on x and y, in the ganglion
+  // cell layer on z. Blocks of cells are drawn in parallel, each from its own
+  // random stream seeded from base_seed: the result does not depend on the
+  // number of threads.
+  inline CellPlacement DrawCellPlacement(uint64_t base_seed, double min,
+                                         double max, int num_cells) {
+    const int block_size = 1024;
+    CellPlacement placement;
+    placement.positions.resize(num_cells);
+    placement.diameters.resize(num_cells);
+    int block_nb = (num_cells + block_size - 1) / block_size;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int block = 0; block < block_nb; block++) {
+      std::seed_seq seed = {base_seed, (uint64_t)block};
+      std::mt19937_64 block_random(seed);
+      std::uniform_real_distribution<double> uniform(0, 1);
+      auto Uniform = [&](double a, double b) {
+        return a + (b - a) * uniform(block_random);
+      };
+
+      int end = std::min(num_cells, (block + 1) * block_size);
+      for (int i = block * block_size; i < end; i++) {
+        double x = Uniform(min + 10, max - 10);
+        double y = Uniform(min + 10, max - 10);
+        // RGCL thickness before cell death ~24
+        double z = Uniform(min + 20, min + 34);
+        placement.positions[i] = {x, y, z};
+        placement.diameters[i] = Uniform(7, 8);
+      }
+    }
+    return placement;
+  }  // end DrawCellPlacement
+
+}  // namespace bdm
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef DELAUNAY_
+#define DELAUNAY_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace bdm {
+
+  // Incremental 2D Delaunay triangulation (Bowyer-Watson). Points are
+  // inserted in a serpentine bucket order so that the walk locating each new
+  // point starts next to it, the cavity is grown from the containing triangle
+  // through neighbour links: near-linear for uniformly spread cells.
+  // Duplicated points are not inserted (IsInserted() is false).
+  class Delaunay2D {
+   public:
+    void Triangulate(const std::vector<double>& x,
+                     const std::vector<double>& y) {
+      size_t n = x.size();
+      px_ = x; py_ = y;
+      inserted_.assign(n, false);
+      vertex_triangle_.assign(n + 3, -1);
+      triangles_.clear();
+      free_.clear();
+      if (n == 0) { return; }
+
+      // super triangle containing all points
+      double min_x = *std::min_element(x.begin(), x.end());
+      double max_x = *std::max_element(x.begin(), x.end());
+      double min_y = *std::min_element(y.begin(), y.end());
+      double max_y = *std::max_element(y.begin(), y.end());
+      double size = std::max(max_x - min_x, max_y - min_y) + 1;
+      double cx = (min_x + max_x) / 2, cy = (min_y + max_y) / 2;
+      px_.push_back(cx - 20 * size); py_.push_back(cy - 10 * size);
+      px_.push_back(cx + 20 * size); py_.push_back(cy - 10 * size);
+      px_.push_back(cx);             py_.push_back(cy + 20 * size);
+      NewTriangle(n, n + 1, n + 2);
+
+      for (uint32_t p : InsertionOrder(min_x, min_y, size)) {
+        Insert(p);
+      }
+    }
+
+    bool IsInserted(uint32_t p) const { return inserted_[p]; }
+
+    // call f(neighbour) for every Delaunay neighbour of p (super triangle
+    // vertices excluded). The nearest neighbour of p is one of them.
+    template <typename F>
+    void ForEachNeighbor(uint32_t p, F&& f) const {
+      ForEachTriangleAround(p, [&](int t, int k) {
+        uint32_t v = triangles_[t].v[(k + 1) % 3];
+        if (v < inserted_.size()) { f(v); }
+        return true;
+      });
+    }
+
+    // area of the Voronoi domain of p, or -1 when it is not closed inside
+    // the triangulation (convex hull cells) or leaves the points bounding box
+    double VoronoiArea(uint32_t p) const {
+      if (!inserted_[p]) { return -1; }
+      std::vector<std::pair<double, double>> polygon;
+      bool closed = ForEachTriangleAround(p, [&](int t, int) {
+        auto& tri = triangles_[t];
+        for (int i = 0; i < 3; i++) {
+          if (tri.v[i] >= inserted_.size()) { return false; }
+        }
+        polygon.push_back({tri.cx, tri.cy});
+        return true;
+      });
+      if (!closed || polygon.size() < 3) { return -1; }
+      double area = 0;
+      for (size_t i = 0; i < polygon.size(); i++) {
+        auto& a = polygon[i];
+        auto& b = polygon[(i + 1) % polygon.size()];
+        if (a.first < box_[0] || a.first > box_[1] || a.second < box_[2] ||
+            a.second > box_[3]) {
+          return -1;
+        }
+        area += a.first * b.second - b.first * a.second;
+      }
+      return std::fabs(area) / 2;
+    }
+
+   private:
+    struct Triangle {
+      uint32_t v[3];
+      // neighbour opposite to vertex i, -1 on the super triangle border
+      int n[3];
+      // circumcircle
+      double cx, cy, r2;
+      bool alive;
+    };
+
+    // serpentine order over a grid of ~2 points per bucket
+    std::vector<uint32_t> InsertionOrder(double min_x, double min_y,
+                                         double size) {
+      size_t n = inserted_.size();
+      box_ = {min_x, min_x, min_y, min_y};
+      int side = std::max(1, static_cast<int>(std::sqrt(n / 2.0)));
+      std::vector<std::pair<uint64_t, uint32_t>> keys(n);
+      for (uint32_t i = 0; i < n; i++) {
+        box_[1] = std::max(box_[1], px_[i]);
+        box_[3] = std::max(box_[3], py_[i]);
+        int bx = std::min(side - 1, static_cast<int>((px_[i] - min_x) / size * side));
+        int by = std::min(side - 1, static_cast<int>((py_[i] - min_y) / size * side));
+        if (by % 2) { bx = side - 1 - bx; }
+        keys[i] = {static_cast<uint64_t>(by) * side + bx, i};
+      }
+      std::sort(keys.begin(), keys.end());
+      std::vector<uint32_t> order(n);
+      for (size_t i = 0; i < n; i++) {
+        order[i] = keys[i].second;
+      }
+      return order;
+    }
+
+    double Orient(uint32_t a, uint32_t b, double x, double y) const {
+      return (px_[b] - px_[a]) * (y - py_[a]) - (py_[b] - py_[a]) * (x - px_[a]);
+    }
+
+    int NewTriangle(uint32_t a, uint32_t b, uint32_t c) {
+      int t;
+      if (free_.empty()) {
+        t = triangles_.size();
+        triangles_.push_back(Triangle());
+      } else {
+        t = free_.back();
+        free_.pop_back();
+      }
+      auto& tri = triangles_[t];
+      tri.v[0] = a; tri.v[1] = b; tri.v[2] = c;
+      tri.n[0] = tri.n[1] = tri.n[2] = -1;
+      tri.alive = true;
+      // circumcenter
+      long double ax = px_[a], ay = py_[a];
+      long double bx = px_[b] - ax, by = py_[b] - ay;
+      long double cx = px_[c] - ax, cy = py_[c] - ay;
+      long double d = 2 * (bx * cy - by * cx);
+      long double b2 = bx * bx + by * by, c2 = cx * cx + cy * cy;
+      long double ux = (cy * b2 - by * c2) / d, uy = (bx * c2 - cx * b2) / d;
+      tri.cx = static_cast<double>(ax + ux);
+      tri.cy = static_cast<double>(ay + uy);
+      tri.r2 = static_cast<double>(ux * ux + uy * uy);
+      vertex_triangle_[a] = vertex_triangle_[b] = vertex_triangle_[c] = t;
+      last_ = t;
+      return t;
+    }
+
+    bool InCircumcircle(int t, double x, double y) const {
+      auto& tri = triangles_[t];
+      double dx = x - tri.cx, dy = y - tri.cy;
+      return dx * dx + dy * dy < tri.r2;
+    }
+
+    // walk from the last created triangle toward (x, y)
+    int Locate(double x, double y) const {
+      int t = last_;
+      for (size_t steps = 0; steps < triangles_.size() + 3; steps++) {
+        auto& tri = triangles_[t];
+        int next = -1;
+        for (int i = 0; i < 3; i++) {
+          if (Orient(tri.v[(i + 1) % 3], tri.v[(i + 2) % 3], x, y) < 0) {
+            next = tri.n[i];
+            break;
+          }
+        }
+        if (next == -1) { return t; }
+        t = next;
+      }
+      // walk cycling on degenerate input: fall back to a linear search
+      for (size_t i = 0; i < triangles_.size(); i++) {
+        if (triangles_[i].alive && InCircumcircle(i, x, y)) { return i; }
+      }
+      return last_;
+    }
+
+    void Insert(uint32_t p) {
+      double x = px_[p], y = py_[p];
+      int start = Locate(x, y);
+      for (int i = 0; i < 3; i++) {
+        uint32_t v = triangles_[start].v[i];
+        if (px_[v] == x && py_[v] == y) { return; }
+      }
+
+      // cavity: connected triangles whose circumcircle contains p
+      cavity_.clear();
+      cavity_.push_back(start);
+      triangles_[start].alive = false;
+      for (size_t c = 0; c < cavity_.size(); c++) {
+        auto& tri = triangles_[cavity_[c]];
+        for (int i = 0; i < 3; i++) {
+          int t = tri.n[i];
+          if (t != -1 && triangles_[t].alive && InCircumcircle(t, x, y)) {
+            triangles_[t].alive = false;
+            cavity_.push_back(t);
+          }
+        }
+      }
+
+      // cavity border edges (a, b) with the triangle outside of it
+      struct Edge { uint32_t a, b; int outside; };
+      std::vector<Edge> border;
+      for (int c : cavity_) {
+        auto& tri = triangles_[c];
+        for (int i = 0; i < 3; i++) {
+          int t = tri.n[i];
+          if (t == -1 || triangles_[t].alive) {
+            border.push_back({tri.v[(i + 1) % 3], tri.v[(i + 2) % 3], t});
+          }
+        }
+      }
+      for (int c : cavity_) {
+        free_.push_back(c);
+      }
+
+      // fan of new triangles (p, a, b)
+      std::vector<int> created(border.size());
+      for (size_t e = 0; e < border.size(); e++) {
+        int t = NewTriangle(p, border[e].a, border[e].b);
+        created[e] = t;
+        triangles_[t].n[0] = border[e].outside;
+        if (border[e].outside != -1) {
+          auto& out = triangles_[border[e].outside];
+          for (int i = 0; i < 3; i++) {
+            if (out.v[i] != border[e].a && out.v[i] != border[e].b) {
+              out.n[i] = t;
+            }
+          }
+        }
+      }
+      for (size_t e = 0; e < border.size(); e++) {
+        for (size_t f = 0; f < border.size(); f++) {
+          // edge (p, a) is shared with the triangle ending on a
+          if (border[f].b == border[e].a) {
+            triangles_[created[e]].n[2] = created[f];
+          }
+          // edge (b, p) is shared with the triangle starting on b
+          if (border[f].a == border[e].b) {
+            triangles_[created[e]].n[1] = created[f];
+          }
+        }
+      }
+      inserted_[p] = true;
+    }
+
+    // visit triangles around p through neighbour links, f(triangle, index of
+    // p in triangle) returning false stops the visit. Returns true if the
+    // whole ring was visited.
+    template <typename F>
+    bool ForEachTriangleAround(uint32_t p, F&& f) const {
+      if (p >= inserted_.size() || !inserted_[p]) { return false; }
+      int start = vertex_triangle_[p];
+      int t = start;
+      do {
+        auto& tri = triangles_[t];
+        int k = tri.v[0] == p ? 0 : (tri.v[1] == p ? 1 : 2);
+        if (!f(t, k)) { return false; }
+        t = tri.n[(k + 1) % 3];
+        if (t == -1) { return false; }
+      } while (t != start);
+      return true;
+    }
+
+    std::vector<double> px_, py_;
+    std::vector<bool> inserted_;
+    std::vector<Triangle> triangles_;
+    std::vector<int> free_;
+    std::vector<int> vertex_triangle_;
+    std::vector<int> cavity_;
+    // points bounding box: min_x, max_x, min_y, max_y
+    std::vector<double> box_;
+    int last_ = 0;
+  };  // end Delaunay2D
+
+}  // namespace bdm
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef DENDRITE_HASH_
+#define DENDRITE_HASH_
+
+#include "biodynamo.h"
+#include "extended_objects.h"
+#include "spatial_hash.h"
+#include "step_index.h"
+#include "substance_field.h"
+
+namespace bdm {
+  using namespace std;
+
+  // squared distance between point p and segment [a, b]; closest point of the
+  // segment is written in closest
+  inline double SquaredDistanceToSegment(const Double3& p, const Double3& a,
+                                         const Double3& b, Double3* closest) {
+    Double3 ab = b - a;
+    double squared_length = ab[0]*ab[0] + ab[1]*ab[1] + ab[2]*ab[2];
+    double t = 0;
+    if (squared_length > 0) {
+      t = ((p[0]-a[0])*ab[0] + (p[1]-a[1])*ab[1] + (p[2]-a[2])*ab[2])
+          / squared_length;
+      t = min(max(t, 0.0), 1.0);
+    }
+    *closest = a + ab * t;
+    Double3 d = p - *closest;
+    return d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+  }
+
+  // Spatial hash of all MyNeurite segments, one per subtype so that
+  // homotypic queries never see other types. Segments are hashed on their
+  // x-y midpoint and the query radius is extended by the longest half
+  // segment, so a query only visits a few buckets whatever the number of
+  // arbors. Rebuilt before each simulation step (step_index.h).
+  class DendriteSegmentHash : public StepIndex {
+   public:
+    static DendriteSegmentHash* Get() {
+      static DendriteSegmentHash hash;
+      return &hash;
+    }
+
+    // largest radius used by queries, sets the bucket length
+    void SetInteractionRadius(double r) { interaction_radius_ = r; }
+
+    // segments of arbors simulated by other processes (domain_decomposition.h),
+    // hashed with the local ones from the next rebuild on
+    struct RemoteSegment {
+      Double3 proximal;
+      Double3 distal;
+      int subtype;
+      SoUid soma;
+    };
+
+    void SetRemoteSegments(vector<RemoteSegment> segments) {
+      remote_segments_.swap(segments);
+    }
+
+    // call f(closest_point, squared_distance) for every segment of the same
+    // subtype, but from another cell, closer than radius to position
+    template <typename F>
+    void ForEachHomotypicSegment(int subtype, SoUid soma,
+                                 const Double3& position, double radius,
+                                 F&& f) {
+      int s = SubstanceIndex(subtype);
+      if (s == -1) { return; }
+      auto& hash = hashes_[s];
+      auto& segments = segments_[s];
+      double squared_radius = radius * radius;
+      hash.ForEachWithin(position[0], position[1], radius + max_half_length_,
+          [&](uint32_t i) {
+            auto& segment = segments[hash.Payload(i)];
+            if (segment.soma == soma) { return; }
+            Double3 closest;
+            double d2 = SquaredDistanceToSegment(
+                position, segment.proximal, segment.distal, &closest);
+            if (d2 < squared_radius) {
+              f(closest, d2);
+            }
+          });
+    }
+
+    void Clear(int thread_nb) override {
+      for (size_t s = 0; s < hashes_.size(); s++) {
+        hashes_[s].Clear();
+        segments_[s].clear();
+      }
+      max_half_length_ = 0;
+      thread_segments_.resize(thread_nb);
+      for (auto& segments : thread_segments_) {
+        segments.clear();
+      }
+    }
+
+    void Add(SimObject* so, int thread) override {
+      auto* ne = dynamic_cast<MyNeurite*>(so);
+      if (!ne) { return; }
+      // uid of the soma pointer, without looking the soma up
+      thread_segments_[thread].push_back(
+          {ne->GetProximalEnd(), ne->GetDistalEnd(), ne->GetSubtype(),
+           ne->GetMySoma().GetUid()});
+    }
+
+    void Build() override {
+      for (auto& segments : thread_segments_) {
+        for (auto& segment : segments) {
+          AddSegment(segment.subtype, segment.proximal, segment.distal,
+                     segment.soma);
+        }
+      }
+      for (auto& remote : remote_segments_) {
+        AddSegment(remote.subtype, remote.proximal, remote.distal, remote.soma);
+      }
+      for (auto& hash : hashes_) {
+        hash.Build(interaction_radius_ + max_half_length_);
+      }
+    }
+
+   private:
+    struct Segment {
+      Double3 proximal;
+      Double3 distal;
+      SoUid soma;
+    };
+
+    DendriteSegmentHash() {}
+
+    void AddSegment(int subtype, const Double3& proximal, const Double3& distal,
+                    SoUid soma) {
+      int s = SubstanceIndex(subtype);
+      if (s == -1) { return; }
+      Double3 middle = (proximal + distal) * 0.5;
+      hashes_[s].Add(middle[0], middle[1], middle[2], segments_[s].size());
+      segments_[s].push_back({proximal, distal, soma});
+      Double3 axis = distal - proximal;
+      max_half_length_ = max(max_half_length_, sqrt(axis[0]*axis[0] +
+                             axis[1]*axis[1] + axis[2]*axis[2]) / 2);
+    }
+
+    double interaction_radius_ = 5;
+    double max_half_length_ = 0;
+    array<SpatialHash2D, 4> hashes_;
+    array<vector<Segment>, 4> segments_;
+    vector<RemoteSegment> remote_segments_;
+    // local segments added by each thread
+    vector<vector<RemoteSegment>> thread_segments_;
+  };  // end DendriteSegmentHash
+
+}  // namespace bdm
+
+#endif
@@ -0,0 +1,496 @@
+#ifndef DOMAIN_DECOMPOSITION_
+#define DOMAIN_DECOMPOSITION_
+
+#include <omp.h>
+#include <cstdlib>
+#include <limits>
+#include "biodynamo.h"
+#include "dendrite_hash.h"
+#include "extended_objects.h"
+#include "rgc_soma_bm.h"
+#include "spatial_hash.h"
+#include "substance_field.h"
+#include "tile_comm.h"
+#include "util_methods.h"
+
+namespace bdm {
+  using namespace std;
+
+  // tiles_x * tiles_y from NEW_RET_TILES ("2x2"), if set
+  inline void ReadTilesFromEnvironment(int* tiles_x, int* tiles_y) {
+    const char* tiles = getenv("NEW_RET_TILES");
+    int x, y;
+    if (tiles && sscanf(tiles, "%dx%d", &x, &y) == 2 && x > 0 && y > 0) {
+      *tiles_x = x;
+      *tiles_y = y;
+    }
+  }
+
+  // start one process per tile, sharing the cores of the machine; must be
+  // called before the simulation (and its threads) is created
+  inline ProcessGroup* LaunchTiles(int tiles_x, int tiles_y) {
+    int rank_nb = tiles_x * tiles_y;
+    auto* group = ProcessGroup::Launch(rank_nb);
+    omp_set_num_threads(max(1, omp_get_num_procs() / rank_nb));
+    return group;
+  }
+
+
+  // Domain decomposition of the retina over local processes, one x-y tile per
+  // process (tile_comm.h). Every process simulates the cells of its tile; at
+  // each step, before the simulation step:
+  // - owned cells that left the tile move to the process of their new tile,
+  //   with their biology modules (cells with dendrites stay where they are)
+  // - processes exchange the extent of their arbors: the x-y bounding box of
+  //   the distal ends of their dendrite segments. Dendrites of cells near a
+  //   tile edge cross it, and stay with their soma
+  // - cells closer than halo to a neighbour tile or to its arbor extent are
+  //   sent to it as ghosts: cells without module, present for one step only,
+  //   seen by mechanics and by the kernel sums of the substance field
+  // - dendrite segments closer than halo to a neighbour tile or to its arbor
+  //   extent become remote segments of the neighbour's DendriteSegmentHash,
+  //   for homotypic avoidance
+  // Arbors must reach no further than the neighbour tiles: a warning is
+  // printed the first time the extent of a process goes beyond them.
+  // Global RI, cell counts and death rate are reductions over all processes.
+  // The substance field must use kernel sums (kKernelSum): diffusion grids
+  // would cover the whole domain in every process.
+  class DomainDecomposition {
+   public:
+    DomainDecomposition(ProcessGroup* group, const TileLayout& layout,
+                        double halo)
+        : group_(group), layout_(layout), halo_(halo),
+          neighbors_(layout.Neighbors(group->GetRank())) {}
+
+    int GetRank() const { return group_->GetRank(); }
+    bool IsRoot() const { return group_->GetRank() == 0; }
+
+    bool Owns(const Double3& position) const {
+      return layout_.Contains(GetRank(), position[0], position[1]);
+    }
+
+    // run steps simulation steps, exchanging with neighbours before each
+    void Simulate(Scheduler* scheduler, int steps) {
+      if (SubstanceField::Get()->UseDiffusionGrid()) {
+        throw runtime_error(
+            "DomainDecomposition: tiles need the kKernelSum substance field");
+      }
+      for (int step = 0; step < steps; step++) {
+        Exchange();
+        SimulateSteps(scheduler, 1);
+        RemoveGhosts();
+      }
+    }
+
+    // same output as GetAllRI, over the whole retina. Positions of the
+    // cells of each type are gathered on rank 0, which finds exact nearest
+    // neighbours (NearestNeighbourRI), and the RIs are sent to every process
+    vector<array<double, 2>> GetAllRI() {
+      auto* rm = Simulation::GetActive()->GetResourceManager();
+      vector<int> types = {-1};
+      types.insert(types.end(), kSecretingTypes.begin(), kSecretingTypes.end());
+
+      struct TypedPosition {
+        int32_t cell_type;
+        double x, y;
+      };
+      vector<char> buffer;
+      rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
+        auto* cell = dynamic_cast<MyCell*>(so);
+        if (!cell) { return; }
+        if (find(types.begin(), types.end(), cell->GetCellType()) ==
+            types.end()) {
+          return;
+        }
+        auto& p = cell->GetPosition();
+        AppendRecord(&buffer, TypedPosition{cell->GetCellType(), p[0], p[1]});
+      });  // end for cell in simulation
+
+      // presence and RI, per type
+      vector<double> result(2 * types.size(), 0);
+      if (IsRoot()) {
+        vector<vector<double>> xs(types.size()), ys(types.size());
+        auto add = [&](const vector<char>& message) {
+          size_t offset = 0;
+          while (offset < message.size()) {
+            auto cell = ReadRecord<TypedPosition>(message, &offset);
+            size_t t = find(types.begin(), types.end(), cell.cell_type) -
+                       types.begin();
+            xs[t].push_back(cell.x);
+            ys[t].push_back(cell.y);
+          }
+        };
+        add(buffer);
+        vector<int> others;
+        for (int r = 1; r < group_->GetSize(); r++) {
+          others.push_back(r);
+        }
+        for (auto& message : group_->Transfer({}, others)) {
+          add(message.second);
+        }
+        for (size_t t = 0; t < types.size(); t++) {
+          if (xs[t].empty()) { continue; }
+          result[2 * t] = 1;
+          result[2 * t + 1] = NearestNeighbourRI(xs[t], ys[t]);
+        }
+      } else {
+        group_->Transfer({{0, buffer}}, {});
+      }
+      // only rank 0 contributes
+      result = group_->AllReduceSum(result);
+
+      vector<array<double, 2>> list_ri;
+      for (size_t t = 0; t < types.size(); t++) {
+        if (result[2 * t] != 0) {
+          list_ri.push_back({result[2 * t + 1], (double)types[t]});
+        }
+      }
+      return list_ri;
+    }  // end GetAllRI
+
+    // number of cells of each type of all_ri, over the whole retina
+    vector<uint64_t> GetCellCounts(const vector<array<double, 2>>& all_ri) {
+      auto* rm = Simulation::GetActive()->GetResourceManager();
+      vector<double> counts(all_ri.size(), 0);
+      rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
+        if (auto* cell = dynamic_cast<MyCell*>(so)) {
+          for (size_t t = 0; t < all_ri.size(); t++) {
+            if (all_ri[t][1] == cell->GetCellType()) {
+              counts[t]++;
+              break;
+            }
+          }
+        }
+      });  // end for cell in simulation
+      counts = group_->AllReduceSum(counts);
+      return vector<uint64_t>(counts.begin(), counts.end());
+    }
+
+    // same as GetDeathRate, num_cells being the number of cells created in
+    // the whole retina
+    double GetDeathRate(int num_cells) {
+      auto* rm = Simulation::GetActive()->GetResourceManager();
+      double cell_in_simu = 0;
+      rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
+        if (dynamic_cast<MyCell*>(so)) {
+          cell_in_simu++;
+        }
+      });  // end for cell in simulation
+      cell_in_simu = group_->AllReduceSum({cell_in_simu})[0];
+      return (1 - (cell_in_simu / num_cells)) * 100;
+    }
+
+    // rank 0 waits for the end of the other processes
+    void Finalize() { group_->Finalize(); }
+
+   private:
+    // same RI as ComputeRi (x-y nearest neighbour distances, cells at the
+    // same position ignored), without its quadratic cost: the query radius
+    // around a cell doubles until it holds a neighbour, which is then the
+    // nearest one
+    static double NearestNeighbourRI(const vector<double>& x,
+                                     const vector<double>& y) {
+      size_t n = x.size();
+      if (n < 2) { return 0; }
+      SpatialHash2D hash;
+      hash.Reserve(n);
+      double min_x = x[0], max_x = x[0], min_y = y[0], max_y = y[0];
+      for (size_t i = 0; i < n; i++) {
+        hash.Add(x[i], y[i], 0, i);
+        min_x = min(min_x, x[i]); max_x = max(max_x, x[i]);
+        min_y = min(min_y, y[i]); max_y = max(max_y, y[i]);
+      }
+      // mean distance between cells
+      double spacing =
+          max(sqrt((max_x - min_x) * (max_y - min_y) / n), 1.0);
+      double diagonal = sqrt(pow(max_x - min_x, 2) + pow(max_y - min_y, 2));
+      hash.Build(spacing);
+
+      double sum = 0, squared_sum = 0;
+      size_t found = 0;
+      for (size_t i = 0; i < n; i++) {
+        double shortest = numeric_limits<double>::max();
+        for (double radius = spacing; ; radius *= 2) {
+          hash.ForEachWithin(x[i], y[i], radius, [&](uint32_t j) {
+            double d = sqrt(pow(hash.X(j) - x[i], 2) + pow(hash.Y(j) - y[i], 2));
+            if (d != 0 && d < shortest) {
+              shortest = d;
+            }
+          });
+          if (shortest <= radius || radius > diagonal) { break; }
+        }
+        if (shortest == numeric_limits<double>::max()) { continue; }
+        sum += shortest;
+        squared_sum += shortest * shortest;
+        found++;
+      }
+      if (found == 0) { return 0; }
+      double mean = sum / found;
+      double std = sqrt(max(squared_sum / found - mean * mean, 0.0));
+      return std > 0 ? mean / std : 0;
+    }  // end NearestNeighbourRI
+
+    // modules of a migrating cell, all stateless
+    enum : uint32_t {
+      kSecretion = 1,
+      kMosaic = 2,
+      kClock = 4,
+      kDendriteCreation = 8
+    };
+
+    struct MigrantRecord {
+      double position[3];
+      double previous_position[3];
+      double diameter;
+      double distance_travelled;
+      int32_t cell_type;
+      int32_t internal_clock;
+      uint32_t modules;
+    };
+
+    struct GhostRecord {
+      double position[3];
+      double diameter;
+      int32_t cell_type;
+      int32_t internal_clock;
+    };
+
+    struct SegmentRecord {
+      double proximal[3];
+      double distal[3];
+      int32_t subtype;
+      uint64_t soma;
+    };
+
+    void Exchange() {
+      auto* sim = Simulation::GetActive();
+      auto* rm = sim->GetResourceManager();
+      int rank = GetRank();
+
+      map<int, vector<MigrantRecord>> migrants;
+      map<int, vector<GhostRecord>> ghosts;
+      map<int, vector<SegmentRecord>> segments;
+      vector<SoUid> leaving;
+      auto extents = ExchangeArborExtents();
+      // (x, y) within margin of the tile or of the arbors of neighbor
+      auto near = [&](int neighbor, const Double3& p, double margin) {
+        return layout_.IsNear(neighbor, p[0], p[1], halo_) ||
+               TileLayout::IsNear(extents[neighbor], p[0], p[1], margin);
+      };
+      rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
+        if (auto* cell = dynamic_cast<MyCell*>(so)) {
+          auto& p = cell->GetPosition();
+          int owner = layout_.RankAt(p[0], p[1]);
+          if (owner != rank && cell->GetDaughters().empty() &&
+              find(neighbors_.begin(), neighbors_.end(), owner) !=
+                  neighbors_.end()) {
+            migrants[owner].push_back(GetMigrantRecord(cell));
+            leaving.push_back(cell->GetUid());
+            return;
+          }
+          for (int n : neighbors_) {
+            if (near(n, p, halo_)) {
+              GhostRecord ghost;
+              Copy(p, ghost.position);
+              ghost.diameter = cell->GetDiameter();
+              ghost.cell_type = cell->GetCellType();
+              ghost.internal_clock = cell->GetInternalClock();
+              ghosts[n].push_back(ghost);
+            }
+          }
+        } else if (auto* ne = dynamic_cast<MyNeurite*>(so)) {
+          if (SubstanceIndex(ne->GetSubtype()) == -1) { return; }
+          // midpoint
+          auto& p = ne->GetPosition();
+          for (int n : neighbors_) {
+            if (near(n, p, halo_ + ne->GetLength() / 2)) {
+              SegmentRecord segment;
+              Copy(ne->GetProximalEnd(), segment.proximal);
+              Copy(ne->GetDistalEnd(), segment.distal);
+              segment.subtype = ne->GetSubtype();
+              segment.soma = ne->GetMySoma()->GetUid();
+              segments[n].push_back(segment);
+            }
+          }
+        }
+      });  // end for cell in simulation
+
+      map<int, vector<char>> outgoing;
+      for (int n : neighbors_) {
+        auto& buffer = outgoing[n];
+        AppendAll(&buffer, migrants[n]);
+        AppendAll(&buffer, ghosts[n]);
+        AppendAll(&buffer, segments[n]);
+      }
+      auto incoming = group_->Transfer(outgoing, neighbors_);
+
+      for (auto uid : leaving) {
+        rm->Remove(uid);
+      }
+
+      vector<DendriteSegmentHash::RemoteSegment> remote_segments;
+      for (auto& message : incoming) {
+        auto& buffer = message.second;
+        size_t offset = 0;
+        for (auto& migrant : ReadAll<MigrantRecord>(buffer, &offset)) {
+          rm->push_back(CreateMigrant(migrant));
+        }
+        for (auto& ghost : ReadAll<GhostRecord>(buffer, &offset)) {
+          MyCell* cell = new MyCell();
+          cell->SetPosition(ToDouble3(ghost.position));
+          cell->SetDiameter(ghost.diameter);
+          cell->SetCellType(ghost.cell_type);
+          cell->SetInternalClock(ghost.internal_clock);
+          ghosts_.push_back(cell->GetUid());
+          rm->push_back(cell);
+        }
+        // remote somas cannot be confused with local ones
+        uint64_t origin = (uint64_t)(message.first + 1) << 48;
+        for (auto& segment : ReadAll<SegmentRecord>(buffer, &offset)) {
+          remote_segments.push_back({ToDouble3(segment.proximal),
+                                     ToDouble3(segment.distal),
+                                     segment.subtype,
+                                     (SoUid)(origin | segment.soma)});
+        }
+      }
+      DendriteSegmentHash::Get()->SetRemoteSegments(move(remote_segments));
+    }  // end Exchange
+
+    // x-y bounding box (x0, x1, y0, y1) of the distal ends of the dendrite
+    // segments of each neighbour, empty if it has none
+    map<int, vector<double>> ExchangeArborExtents() {
+      auto* rm = Simulation::GetActive()->GetResourceManager();
+      double inf = numeric_limits<double>::infinity();
+      vector<double> extent = {inf, -inf, inf, -inf};
+      rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
+        if (auto* ne = dynamic_cast<MyNeurite*>(so)) {
+          const auto& d = ne->GetDistalEnd();
+          extent[0] = min(extent[0], d[0]);
+          extent[1] = max(extent[1], d[0]);
+          extent[2] = min(extent[2], d[1]);
+          extent[3] = max(extent[3], d[1]);
+        }
+      });  // end for neurite in simulation
+      CheckArborReach(extent);
+
+      map<int, vector<char>> outgoing;
+      for (int n : neighbors_) {
+        AppendAll(&outgoing[n], extent);
+      }
+      map<int, vector<double>> extents;
+      for (auto& message : group_->Transfer(outgoing, neighbors_)) {
+        size_t offset = 0;
+        extents[message.first] = ReadAll<double>(message.second, &offset);
+      }
+      return extents;
+    }
+
+    // segments and ghosts are only exchanged with neighbour tiles
+    void CheckArborReach(const vector<double>& extent) {
+      if (arbor_reach_warned_ || extent[0] > extent[1]) { return; }
+      auto reach = layout_.GetBounds(GetRank());
+      for (int n : neighbors_) {
+        auto b = layout_.GetBounds(n);
+        reach = {min(reach[0], b[0]), max(reach[1], b[1]),
+                 min(reach[2], b[2]), max(reach[3], b[3])};
+      }
+      if (extent[0] < reach[0] || extent[1] > reach[1] ||
+          extent[2] < reach[2] || extent[3] > reach[3]) {
+        cout << "warning: arbors of tile " << GetRank()
+             << " reach past its neighbour tiles, use fewer tiles" << endl;
+        arbor_reach_warned_ = true;
+      }
+    }
+
+    void RemoveGhosts() {
+      auto* rm = Simulation::GetActive()->GetResourceManager();
+      for (auto uid : ghosts_) {
+        rm->Remove(uid);
+      }
+      ghosts_.clear();
+    }
+
+    MigrantRecord GetMigrantRecord(MyCell* cell) {
+      MigrantRecord migrant;
+      Copy(cell->GetPosition(), migrant.position);
+      Copy(cell->GetPreviousPosition(), migrant.previous_position);
+      migrant.diameter = cell->GetDiameter();
+      migrant.distance_travelled = cell->GetDistanceTravelled();
+      migrant.cell_type = cell->GetCellType();
+      migrant.internal_clock = cell->GetInternalClock();
+      migrant.modules = 0;
+      for (auto* bm : cell->GetAllBiologyModules()) {
+        if (dynamic_cast<Substance_secretion_BM*>(bm)) {
+          migrant.modules |= kSecretion;
+        } else if (dynamic_cast<RGC_mosaic_BM*>(bm)) {
+          migrant.modules |= kMosaic;
+        } else if (dynamic_cast<Internal_clock_BM*>(bm)) {
+          migrant.modules |= kClock;
+        } else if (dynamic_cast<Dendrite_creation_BM*>(bm)) {
+          migrant.modules |= kDendriteCreation;
+        }
+      }
+      return migrant;
+    }
+
+    MyCell* CreateMigrant(const MigrantRecord& migrant) {
+      MyCell* cell = new MyCell();
+      cell->SetPosition(ToDouble3(migrant.position));
+      cell->SetPreviousPosition(ToDouble3(migrant.previous_position));
+      cell->SetDiameter(migrant.diameter);
+      cell->SetDistanceTravelled(migrant.distance_travelled);
+      cell->SetCellType(migrant.cell_type);
+      cell->SetInternalClock(migrant.internal_clock);
+      // same module order as CellCreator
+      if (migrant.modules & kSecretion) {
+        cell->AddBiologyModule(new Substance_secretion_BM());
+      }
+      if (migrant.modules & kMosaic) {
+        cell->AddBiologyModule(new RGC_mosaic_BM());
+      }
+      if (migrant.modules & kClock) {
+        cell->AddBiologyModule(new Internal_clock_BM());
+      }
+      if (migrant.modules & kDendriteCreation) {
+        cell->AddBiologyModule(new Dendrite_creation_BM());
+      }
+      return cell;
+    }
+
+    template <typename T>
+    static void AppendAll(vector<char>* buffer, const vector<T>& records) {
+      AppendRecord(buffer, (uint64_t)records.size());
+      for (auto& record : records) {
+        AppendRecord(buffer, record);
+      }
+    }
+
+    template <typename T>
+    static vector<T> ReadAll(const vector<char>& buffer, size_t* offset) {
+      vector<T> records(ReadRecord<uint64_t>(buffer, offset));
+      for (auto& record : records) {
+        record = ReadRecord<T>(buffer, offset);
+      }
+      return records;
+    }
+
+    static void Copy(const Double3& from, double* to) {
+      to[0] = from[0];
+      to[1] = from[1];
+      to[2] = from[2];
+    }
+
+    static Double3 ToDouble3(const double* v) { return {v[0], v[1], v[2]}; }
+
+    ProcessGroup* group_;
+    TileLayout layout_;
+    double halo_;
+    vector<int> neighbors_;
+    // uids of the ghosts of the current step
+    vector<SoUid> ghosts_;
+    bool arbor_reach_warned_ = false;
+  };  // end DomainDecomposition
+
+}  // namespace bdm
+
+#endif
@@ -1,17 +1,32 @@
 #ifndef EXTENDED_OBJECTS_
 #define EXTENDED_OBJECTS_
 
+#include "monolayer.h"
 #include "neuroscience/neuroscience.h"
 
 namespace bdm {
 
   // Define custom cell MyCell extending NeuronSoma
+  // With NEW_RET_COMPACT_ATTRIBUTES, migration tracking (previous position and
+  // distance travelled) is not stored: setters do nothing, the previous
+  // position is the current one and the distance travelled is 0.
   class MyCell : public experimental::neuroscience::NeuronSoma {
+#ifdef NEW_RET_COMPACT_ATTRIBUTES
     BDM_SIM_OBJECT_HEADER(MyCell, experimental::neuroscience::NeuronSoma, 1,
-                          cell_type_, internal_clock_, swc_label_,
+                          cell_type_, internal_clock_);
+#else
+    BDM_SIM_OBJECT_HEADER(MyCell, experimental::neuroscience::NeuronSoma, 1,
+                          cell_type_, internal_clock_,
                           previous_position_, distance_travelled_);
+#endif
 
    public:
+#ifdef NEW_RET_COMPACT_ATTRIBUTES
+    static constexpr bool kTrackMigration = false;
+#else
+    static constexpr bool kTrackMigration = true;
+#endif
+
     MyCell() : Base() {}
 
     virtual ~MyCell() {}
@@ -28,30 +43,55 @@ namespace bdm {
     void SetInternalClock(int t) { internal_clock_ = t; }
     int GetInternalClock() const { return internal_clock_; }
 
-    inline void SetLabel(int label) { swc_label_ = label; }
-    inline int GetLabel() const { return swc_label_; }
-    inline void IncreaseLabel() { swc_label_ += 1; }
+#ifdef NEW_RET_COMPACT_ATTRIBUTES
+    void SetPreviousPosition(Double3) {}
+    const Double3& GetPreviousPosition() const { return GetPosition(); }
 
+    void SetDistanceTravelled(double) {}
+    double GetDistanceTravelled() const { return 0; }
+#else
     void SetPreviousPosition(Double3 position) { previous_position_ = position; }
     const Double3& GetPreviousPosition() const { return previous_position_; }
 
     void SetDistanceTravelled(double distance) { distance_travelled_ = distance; }
     double GetDistanceTravelled() const {return distance_travelled_; }
+#endif
+
+    // in-plane mechanics once in the layer phase (see monolayer.h)
+    Double3 CalculateDisplacement(double squared_radius, double dt) override {
+      auto* monolayer = MonolayerMechanics::Get();
+      if (monolayer->IsInLayer(internal_clock_)) {
+        return monolayer->CalculateDisplacement(this, dt);
+      }
+      return Base::CalculateDisplacement(squared_radius, dt);
+    }
 
    private:
+#ifdef NEW_RET_COMPACT_ATTRIBUTES
+     int16_t cell_type_ = -1;
+     int internal_clock_ = 0;
+#else
      int cell_type_ = -1;
      int internal_clock_ = 0;
-     int swc_label_ = 0;
      Double3 previous_position_;
      double distance_travelled_ = 0;
+#endif
   }; // end MyCell definition
 
 
   // Define custom neurite MyNeurite extending NeuriteElement
+  // With NEW_RET_COMPACT_ATTRIBUTES, retraction flags are packed in one byte,
+  // the diameter before retraction is a float and the subtype is not stored:
+  // it is the cell type of the soma, read through its SoPointer.
   class MyNeurite : public experimental::neuroscience::NeuriteElement {
+#ifdef NEW_RET_COMPACT_ATTRIBUTES
+    BDM_SIM_OBJECT_HEADER(MyNeurite, experimental::neuroscience::NeuriteElement, 1,
+                          flags_, diam_before_retract_, its_soma_);
+#else
     BDM_SIM_OBJECT_HEADER(MyNeurite, experimental::neuroscience::NeuriteElement, 1,
                           has_to_retract_, beyond_threshold_,
                           diam_before_retract_, subtype_, its_soma_);
+#endif
 
    public:
     MyNeurite() : Base() {}
@@ -64,8 +104,22 @@ namespace bdm {
       if (event.GetId() ==
       experimental::neuroscience::NewNeuriteExtensionEvent::kEventId) {
         its_soma_ = static_cast<MyCell*>(other)->GetSoPtr<MyCell>();
+#ifndef NEW_RET_COMPACT_ATTRIBUTES
+        subtype_ = static_cast<MyCell*>(other)->GetCellType();
+#endif
       } else {
-        its_soma_ = static_cast<MyNeurite*>(other)->its_soma_;
+        // elongation split or bifurcation: new element is part of the same
+        // dendrite, growing or retracting as its mother did
+        auto* mother = static_cast<MyNeurite*>(other);
+        its_soma_ = mother->its_soma_;
+#ifdef NEW_RET_COMPACT_ATTRIBUTES
+        flags_ = mother->flags_;
+#else
+        subtype_ = mother->subtype_;
+        has_to_retract_ = mother->has_to_retract_;
+        beyond_threshold_ = mother->beyond_threshold_;
+#endif
+        diam_before_retract_ = mother->diam_before_retract_;
       }
     }
 
@@ -75,27 +129,53 @@ namespace bdm {
       Base::EventHandler(event, other1, other2);
     }
 
+#ifdef NEW_RET_COMPACT_ATTRIBUTES
+    void SetHasToRetract(int r) { SetFlag(kHasToRetract, r); }
+    bool GetHasToRetract() const { return flags_ & kHasToRetract; }
+
+    void SetBeyondThreshold(int r) { SetFlag(kBeyondThreshold, r); }
+    bool GetBeyondThreshold() const { return flags_ & kBeyondThreshold; }
+#else
     void SetHasToRetract(int r) { has_to_retract_ = r; }
     bool GetHasToRetract() const { return has_to_retract_; }
 
     void SetBeyondThreshold(int r) { beyond_threshold_ = r; }
     bool GetBeyondThreshold() const { return beyond_threshold_; }
+#endif
 
     void SetDiamBeforeRetraction(double d) { diam_before_retract_ = d; }
     double GetDiamBeforeRetraction() const { return diam_before_retract_; }
 
+#ifdef NEW_RET_COMPACT_ATTRIBUTES
+    void SetSubtype(int) {}
+    int GetSubtype() { return its_soma_->GetCellType(); }
+#else
     void SetSubtype(int st) { subtype_ = st; }
     int GetSubtype() { return subtype_; }
+#endif
 
     void SetMySoma(SoPointer<MyCell> soma) { its_soma_ = soma; }
     SoPointer<MyCell> GetMySoma() { return its_soma_; }
 
    private:
-     bool has_to_retract_;
-     bool beyond_threshold_;
-     double diam_before_retract_;
-     int subtype_;
+#ifdef NEW_RET_COMPACT_ATTRIBUTES
+     static constexpr uint8_t kHasToRetract = 1;
+     static constexpr uint8_t kBeyondThreshold = 2;
+
+     void SetFlag(uint8_t flag, bool value) {
+       flags_ = value ? (flags_ | flag) : (flags_ & ~flag);
+     }
+
      SoPointer<MyCell> its_soma_;
+     float diam_before_retract_ = 0;
+     uint8_t flags_ = 0;
+#else
+     bool has_to_retract_ = false;
+     bool beyond_threshold_ = false;
+     double diam_before_retract_ = 0;
+     int subtype_ = -1;
+     SoPointer<MyCell> its_soma_;
+#endif
   }; // end MyNeurite definition
 
 
@@ -0,0 +1,268 @@
+#ifndef LOD_EXPORT_
+#define LOD_EXPORT_
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include "biodynamo.h"
+#include "extended_objects.h"
+#include "memory_report.h"
+
+namespace bdm {
+  using namespace std;
+
+  // Decimated visualization export for large retinas, as an alternative to
+  // the export of every MyCell and MyNeurite set in bdm.toml. Each frame is
+  // one legacy binary VTK polydata file (ParaView reads it directly):
+  // - somas are vertices and neurite elements are lines, with cell_type and
+  //   diameter point data
+  // - coordinates are quantized on 16 bits over the export region; the
+  //   "quantization" field data holds origin x, y, z and scale
+  //   (position = origin + scale * value, ParaView Transform filter)
+  // - cells are selected by region of interest, per-type sampling and one
+  //   soma per x-y voxel; a cell is kept or dropped with its whole arbor
+  // - the frame budget is enforced by keeping cells in a stable pseudo random
+  //   order (hash of uid) until it is reached, so the same cells are kept
+  //   from one frame to the next
+  struct LodExportParam {
+    bool enabled = false;
+    // 0: no limit
+    size_t frame_budget = 8 << 20;
+    bool crop = false;
+    Double3 roi_min = {0, 0, 0};
+    Double3 roi_max = {0, 0, 0};
+    // side of the x-y voxels keeping one soma each, 0: no decimation
+    double voxel_size = 0;
+    // fraction of cells exported per type, types not listed are all exported
+    map<int, double> type_sampling;
+    bool export_neurites = true;
+  };  // end LodExportParam
+
+
+  // stable value in [0, 1) for a uid
+  inline double LodHash(uint64_t uid) {
+    uint64_t h = uid + 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h = h ^ (h >> 31);
+    return (h >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+
+  // legacy VTK binary data is big endian
+  template <typename T>
+  inline void AppendBigEndian(vector<char>* buffer, T value) {
+    char bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    for (size_t i = sizeof(T); i-- > 0;) {
+      buffer->push_back(bytes[i]);
+    }
+  }
+
+  inline void AppendText(vector<char>* buffer, const string& text) {
+    buffer->insert(buffer->end(), text.begin(), text.end());
+  }
+
+
+  inline void WriteLodFrame(const LodExportParam& lod, int step, int seed) {
+    auto* sim = Simulation::GetActive();
+    auto* rm = sim->GetResourceManager();
+    auto* param = sim->GetParam();
+
+    // bytes of one soma (point, vertex, point data) and one neurite element
+    const size_t soma_bytes = 3 * 2 + 2 * 4 + 2 + 1;
+    const size_t neurite_bytes = 2 * (3 * 2 + 2 + 1) + 3 * 4;
+    const size_t header_bytes = 512;
+
+    Double3 origin = {param->min_bound_, param->min_bound_, param->min_bound_};
+    Double3 extent = {param->max_bound_, param->max_bound_, param->max_bound_};
+    if (lod.crop) {
+      origin = lod.roi_min;
+      extent = lod.roi_max;
+    }
+    auto in_roi = [&](const Double3& p) {
+      return !lod.crop ||
+        (p[0] >= origin[0] && p[0] <= extent[0] && p[1] >= origin[1] &&
+         p[1] <= extent[1] && p[2] >= origin[2] && p[2] <= extent[2]);
+    };
+
+    struct Candidate {
+      double hash;
+      uint64_t uid;
+      Double3 position;
+      int cell_type;
+      double diameter;
+      size_t neurite_nb;
+    };
+    vector<Candidate> candidates;
+    unordered_map<uint64_t, size_t> neurite_nb;
+
+    /* -- selection of cells in region and sampled types -- */
+    rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
+      if (auto* cell = dynamic_cast<MyCell*>(so)) {
+        if (!in_roi(cell->GetPosition())) { return; }
+        uint64_t uid = cell->GetUid();
+        double hash = LodHash(uid);
+        auto sampling = lod.type_sampling.find(cell->GetCellType());
+        if (sampling != lod.type_sampling.end() && hash >= sampling->second) {
+          return;
+        }
+        candidates.push_back({LodHash(~uid), uid, cell->GetPosition(),
+                              cell->GetCellType(), cell->GetDiameter(), 0});
+      } else if (lod.export_neurites) {
+        if (auto* ne = dynamic_cast<MyNeurite*>(so)) {
+          neurite_nb[ne->GetMySoma()->GetUid()]++;
+        }
+      }
+    });  // end for cell in simulation
+
+    // one soma per voxel: the one with the lowest hash
+    if (lod.voxel_size > 0) {
+      unordered_map<uint64_t, size_t> voxels;
+      for (size_t i = 0; i < candidates.size(); i++) {
+        auto& p = candidates[i].position;
+        uint64_t vx = (uint64_t)((p[0] - origin[0]) / lod.voxel_size);
+        uint64_t vy = (uint64_t)((p[1] - origin[1]) / lod.voxel_size);
+        auto it = voxels.insert({(vy << 32) | vx, i}).first;
+        if (candidates[i].hash < candidates[it->second].hash) {
+          it->second = i;
+        }
+      }
+      vector<Candidate> decimated;
+      for (auto& voxel : voxels) {
+        decimated.push_back(candidates[voxel.second]);
+      }
+      candidates.swap(decimated);
+    }
+
+    // frame budget
+    sort(candidates.begin(), candidates.end(),
+         [](const Candidate& a, const Candidate& b) { return a.hash < b.hash; });
+    size_t bytes = header_bytes;
+    size_t kept = 0;
+    for (; kept < candidates.size(); kept++) {
+      auto it = neurite_nb.find(candidates[kept].uid);
+      candidates[kept].neurite_nb = it == neurite_nb.end() ? 0 : it->second;
+      size_t cell_bytes =
+          soma_bytes + candidates[kept].neurite_nb * neurite_bytes;
+      if (lod.frame_budget != 0 && bytes + cell_bytes > lod.frame_budget) {
+        break;
+      }
+      bytes += cell_bytes;
+    }
+    candidates.resize(kept);
+
+    /* -- neurites of kept cells -- */
+    struct Segment {
+      Double3 proximal, distal;
+      int cell_type;
+      double diameter;
+    };
+    vector<Segment> segments;
+    if (lod.export_neurites) {
+      unordered_set<uint64_t> kept_uids;
+      for (auto& candidate : candidates) {
+        if (candidate.neurite_nb != 0) {
+          kept_uids.insert(candidate.uid);
+        }
+      }
+      rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
+        auto* ne = dynamic_cast<MyNeurite*>(so);
+        if (ne && kept_uids.count(ne->GetMySoma()->GetUid()) &&
+            in_roi(ne->GetPosition())) {
+          segments.push_back({ne->GetProximalEnd(), ne->GetDistalEnd(),
+                              ne->GetSubtype(), ne->GetDiameter()});
+        }
+      });  // end for neurite in simulation
+    }
+
+    /* -- frame -- */
+    double scale = 0;
+    for (int d = 0; d < 3; d++) {
+      scale = max(scale, (extent[d] - origin[d]) / 65535);
+    }
+    auto quantize = [&](double v, int d) {
+      double q = round((v - origin[d]) / scale);
+      return (uint16_t)min(max(q, 0.0), 65535.0);
+    };
+    size_t point_nb = candidates.size() + 2 * segments.size();
+
+    vector<char> frame;
+    frame.reserve(bytes);
+    size_t buffer_bytes = frame.capacity();
+    ExportBufferBytes() += buffer_bytes;
+    AppendText(&frame, Concat("# vtk DataFile Version 3.0\nnew_ret step ",
+                              step, " seed ", seed, "\nBINARY\n",
+                              "DATASET POLYDATA\n",
+                              "FIELD FieldData 1\nquantization 4 1 double\n"));
+    for (int d = 0; d < 3; d++) {
+      AppendBigEndian(&frame, origin[d]);
+    }
+    AppendBigEndian(&frame, scale);
+    AppendText(&frame, Concat("\nPOINTS ", point_nb, " unsigned_short\n"));
+    auto append_point = [&](const Double3& p) {
+      for (int d = 0; d < 3; d++) {
+        AppendBigEndian(&frame, quantize(p[d], d));
+      }
+    };
+    for (auto& candidate : candidates) {
+      append_point(candidate.position);
+    }
+    for (auto& segment : segments) {
+      append_point(segment.proximal);
+      append_point(segment.distal);
+    }
+
+    AppendText(&frame, Concat("\nVERTICES ", candidates.size(), " ",
+                              2 * candidates.size(), "\n"));
+    for (size_t i = 0; i < candidates.size(); i++) {
+      AppendBigEndian(&frame, (int32_t)1);
+      AppendBigEndian(&frame, (int32_t)i);
+    }
+    AppendText(&frame, Concat("\nLINES ", segments.size(), " ",
+                              3 * segments.size(), "\n"));
+    for (size_t i = 0; i < segments.size(); i++) {
+      int32_t first = candidates.size() + 2 * i;
+      AppendBigEndian(&frame, (int32_t)2);
+      AppendBigEndian(&frame, first);
+      AppendBigEndian(&frame, first + 1);
+    }
+
+    AppendText(&frame, Concat("\nPOINT_DATA ", point_nb,
+                              "\nSCALARS cell_type short 1\n",
+                              "LOOKUP_TABLE default\n"));
+    for (auto& candidate : candidates) {
+      AppendBigEndian(&frame, (int16_t)candidate.cell_type);
+    }
+    for (auto& segment : segments) {
+      AppendBigEndian(&frame, (int16_t)segment.cell_type);
+      AppendBigEndian(&frame, (int16_t)segment.cell_type);
+    }
+    // diameter in tenth of um, saturating at 25.5 um
+    auto quantize_diameter = [](double diameter) {
+      return (uint8_t)min(round(diameter * 10), 255.0);
+    };
+    AppendText(&frame,
+               "\nSCALARS diameter_x10 unsigned_char 1\nLOOKUP_TABLE default\n");
+    for (auto& candidate : candidates) {
+      frame.push_back(quantize_diameter(candidate.diameter));
+    }
+    for (auto& segment : segments) {
+      frame.push_back(quantize_diameter(segment.diameter));
+      frame.push_back(quantize_diameter(segment.diameter));
+    }
+    AppendText(&frame, "\n");
+
+    string file_name = Concat(param->output_dir_, "/results", seed,
+                              "/lod/frame_", step, ".vtk");
+    if (FILE* file = fopen(file_name.c_str(), "wb")) {
+      fwrite(frame.data(), 1, frame.size(), file);
+      fclose(file);
+    }
+    ExportBufferBytes() -= buffer_bytes;
+  }  // end WriteLodFrame
+
+}  // namespace bdm
+
+#endif
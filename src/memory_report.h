@@ -0,0 +1,129 @@
+#ifndef MEMORY_REPORT_
+#define MEMORY_REPORT_
+
+#include <unistd.h>
+#include <atomic>
+#include "biodynamo.h"
+#include "extended_objects.h"
+#include "rgc_dendrite_bm.h"
+#include "rgc_soma_bm.h"
+#include "substance_field.h"
+
+namespace bdm {
+  using namespace std;
+
+  // bytes currently held by export buffers (telemetry, visualization...);
+  // exporters add what they allocate and remove what they release
+  inline atomic<size_t>& ExportBufferBytes() {
+    static atomic<size_t> bytes{0};
+    return bytes;
+  }
+
+  // Breakdown of the memory used by the model. Object sizes come from the
+  // resource manager content (object size, daughter and module pointers),
+  // modules from their pools and diffusion grids from their number of boxes
+  // (two concentration and three gradient values per box). Everything not
+  // accounted for is the difference to the resident set size.
+  struct MemoryReport {
+    size_t resident_bytes = 0;
+    size_t cell_nb = 0;
+    size_t cell_bytes = 0;
+    size_t neurite_nb = 0;
+    size_t neurite_bytes = 0;
+    size_t module_nb = 0;
+    size_t module_bytes = 0;
+    // pooled blocks of the RGC_dendrite_BM of neurite elements
+    size_t dendrite_module_bytes = 0;
+    size_t diffusion_grid_bytes = 0;
+    size_t export_buffer_bytes = 0;
+
+    size_t AccountedBytes() const {
+      return cell_bytes + neurite_bytes + module_bytes + diffusion_grid_bytes +
+             export_buffer_bytes;
+    }
+
+    // footprint of one million neurite elements, with their RGC_dendrite_BM
+    double BytesPerMillionNeurites() const {
+      if (neurite_nb == 0) { return 0; }
+      return 1e6 * (double)(neurite_bytes + dendrite_module_bytes) / neurite_nb;
+    }
+  };  // end MemoryReport
+
+
+  inline size_t GetResidentBytes() {
+    ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+  }
+
+
+  inline MemoryReport GetMemoryReport() {
+    auto* rm = Simulation::GetActive()->GetResourceManager();
+    MemoryReport report;
+    report.resident_bytes = GetResidentBytes();
+
+    rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
+      size_t module_nb = so->GetAllBiologyModules().size();
+      size_t bytes = module_nb * sizeof(BaseBiologyModule*);
+      report.module_nb += module_nb;
+      if (auto* cell = dynamic_cast<MyCell*>(so)) {
+        report.cell_nb++;
+        report.cell_bytes += bytes + sizeof(MyCell) +
+          cell->GetDaughters().size() * sizeof(cell->GetDaughters()[0]);
+      } else if (dynamic_cast<MyNeurite*>(so)) {
+        report.neurite_nb++;
+        report.neurite_bytes += bytes + sizeof(MyNeurite);
+        for (auto* bm : so->GetAllBiologyModules()) {
+          if (dynamic_cast<RGC_dendrite_BM*>(bm)) {
+            report.dendrite_module_bytes +=
+                ModulePool<sizeof(RGC_dendrite_BM)>::BlockBytes();
+          }
+        }
+      }
+    });  // end for cell in simulation
+
+    // modules of the same size share a pool
+    vector<pair<size_t, size_t>> pools = {
+      {sizeof(RGC_mosaic_BM), ModulePool<sizeof(RGC_mosaic_BM)>::ReservedBytes()},
+      {sizeof(Substance_secretion_BM), ModulePool<sizeof(Substance_secretion_BM)>::ReservedBytes()},
+      {sizeof(Internal_clock_BM), ModulePool<sizeof(Internal_clock_BM)>::ReservedBytes()},
+      {sizeof(Dendrite_creation_BM), ModulePool<sizeof(Dendrite_creation_BM)>::ReservedBytes()},
+      {sizeof(RGC_dendrite_BM), ModulePool<sizeof(RGC_dendrite_BM)>::ReservedBytes()}};
+    sort(pools.begin(), pools.end());
+    pools.erase(unique(pools.begin(), pools.end()), pools.end());
+    for (auto& pool : pools) {
+      report.module_bytes += pool.second;
+    }
+
+    if (SubstanceField::Get()->UseDiffusionGrid()) {
+      for (auto& name : kSubstanceNames) {
+        if (auto* dg = rm->GetDiffusionGrid(name)) {
+          report.diffusion_grid_bytes += dg->GetNumBoxes() * 5 * sizeof(double);
+        }
+      }
+    }
+    report.export_buffer_bytes = ExportBufferBytes().load();
+    return report;
+  }  // end GetMemoryReport
+
+
+  // step resident cells cell_bytes neurites neurite_bytes modules
+  // module_bytes diffusion_grid_bytes export_buffer_bytes unaccounted_bytes
+  // bytes_per_million_neurites
+  inline void WriteMemoryReport(ofstream& output, int step) {
+    MemoryReport report = GetMemoryReport();
+    size_t accounted = report.AccountedBytes();
+    size_t unaccounted = report.resident_bytes > accounted ?
+                         report.resident_bytes - accounted : 0;
+    output << step << " " << report.resident_bytes << " " << report.cell_nb
+           << " " << report.cell_bytes << " " << report.neurite_nb << " "
+           << report.neurite_bytes << " " << report.module_nb << " "
+           << report.module_bytes << " " << report.diffusion_grid_bytes << " "
+           << report.export_buffer_bytes << " " << unaccounted << " "
+           << report.BytesPerMillionNeurites() << "\n";
+  }  // end WriteMemoryReport
+
+}  // namespace bdm
+
+#endif
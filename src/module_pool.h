@@ -0,0 +1,139 @@
+#ifndef MODULE_POOL_
+#define MODULE_POOL_
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace bdm {
+
+  // Fixed-size block pool for biology modules. Stateless modules are tiny
+  // (vtable pointer and event masks) and every cell owns its own copies, so
+  // going through malloc for each of them costs time at cell creation and
+  // allocator overhead per module. Blocks are carved from large chunks and
+  // recycled through thread local free lists: creating and removing modules
+  // from parallel biology modules does not contend on a lock. Used blocks
+  // are counted per thread as well (a thread may free blocks allocated by
+  // another, so a count can be negative) and only summed by UsedBytes().
+  // Chunks are kept until the end of the program.
+  template <size_t kBlockSize>
+  class ModulePool {
+   public:
+    static void* Allocate() {
+      auto& free_list = FreeList();
+      if (free_list.empty()) {
+        Refill(&free_list);
+      }
+      void* block = free_list.back();
+      free_list.pop_back();
+      UsedBlocks().count++;
+      return block;
+    }
+
+    static void Free(void* block) {
+      FreeList().push_back(block);
+      UsedBlocks().count--;
+    }
+
+    static size_t ReservedBytes() { return chunk_nb_ * kChunkSize; }
+    static size_t UsedBytes() {
+      std::lock_guard<std::mutex> lock(CounterMutex());
+      long used_blocks = RetiredBlocks();
+      for (auto* counter : Counters()) {
+        used_blocks += counter->count;
+      }
+      return used_blocks > 0 ? used_blocks * kStride : 0;
+    }
+    // bytes taken by one block
+    static constexpr size_t BlockBytes() { return kStride; }
+
+   private:
+    static constexpr size_t kAlignment = alignof(std::max_align_t);
+    static constexpr size_t kStride =
+        (kBlockSize + kAlignment - 1) / kAlignment * kAlignment;
+    static constexpr size_t kChunkSize = 1 << 16;
+
+    static std::vector<void*>& FreeList() {
+      static thread_local std::vector<void*> free_list;
+      return free_list;
+    }
+
+    // blocks allocated minus blocks freed by one thread, registered while
+    // the thread lives; its count is kept in RetiredBlocks() when it exits
+    struct Counter {
+      long count = 0;
+      Counter() {
+        std::lock_guard<std::mutex> lock(CounterMutex());
+        Counters().push_back(this);
+      }
+      ~Counter() {
+        std::lock_guard<std::mutex> lock(CounterMutex());
+        RetiredBlocks() += count;
+        auto& counters = Counters();
+        for (size_t i = 0; i < counters.size(); i++) {
+          if (counters[i] == this) {
+            counters[i] = counters.back();
+            counters.pop_back();
+            break;
+          }
+        }
+      }
+    };
+
+    static Counter& UsedBlocks() {
+      static thread_local Counter counter;
+      return counter;
+    }
+
+    static std::mutex& CounterMutex() {
+      static std::mutex mutex;
+      return mutex;
+    }
+
+    static std::vector<Counter*>& Counters() {
+      static std::vector<Counter*> counters;
+      return counters;
+    }
+
+    static long& RetiredBlocks() {
+      static long retired = 0;
+      return retired;
+    }
+
+    static void Refill(std::vector<void*>* free_list) {
+      char* chunk = static_cast<char*>(::operator new(kChunkSize));
+      chunk_nb_++;
+      for (size_t offset = 0; offset + kStride <= kChunkSize;
+           offset += kStride) {
+        free_list->push_back(chunk + offset);
+      }
+    }
+
+    static std::atomic<size_t> chunk_nb_;
+  };  // end ModulePool
+
+  template <size_t kBlockSize>
+  std::atomic<size_t> ModulePool<kBlockSize>::chunk_nb_{0};
+
+// Route new/delete of a biology module through ModulePool. Derived classes
+// of a different size fall back to the global operators.
+#define POOLED_BM_ALLOCATOR(class_name)                                    \
+  static void* operator new(size_t size) {                                 \
+    if (size == sizeof(class_name)) {                                      \
+      return ModulePool<sizeof(class_name)>::Allocate();                   \
+    }                                                                      \
+    return ::operator new(size);                                           \
+  }                                                                        \
+  static void operator delete(void* p, size_t size) {                      \
+    if (size == sizeof(class_name)) {                                      \
+      ModulePool<sizeof(class_name)>::Free(p);                             \
+      return;                                                              \
+    }                                                                      \
+    ::operator delete(p);                                                  \
+  }
+
+}  // namespace bdm
+
+#endif
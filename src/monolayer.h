@@ -0,0 +1,191 @@
+#ifndef MONOLAYER_
+#define MONOLAYER_
+
+#include "biodynamo.h"
+#include "neuroscience/neuroscience.h"
+#include "spatial_hash.h"
+#include "step_index.h"
+
+namespace bdm {
+  using namespace std;
+
+  // Z-constrained mechanics for the ganglion cell layer. Once the internal
+  // clock of a soma reached start_clock (by default the end of the cell
+  // death phase of RGC_mosaic_BM, when the multilayer has collapsed), the
+  // soma is pulled to layer_z, by at most the max displacement per step, and
+  // its neighbours are searched in a 2D hash of the x-y positions of somas
+  // and neurite elements instead of the 3D grid. Forces are computed in-plane.
+  // The hash holds copies of positions, diameters and uids, never pointers
+  // to simulation objects.
+  // Neurite elements keep the default mechanics: they see the somas through
+  // the 3D grid, and somas see them through the hash, ignoring their own
+  // primary elements as in NeuronSoma.
+  class MonolayerMechanics : public StepIndex {
+    using NeuriteElement = experimental::neuroscience::NeuriteElement;
+    using NeuronSoma = experimental::neuroscience::NeuronSoma;
+
+   public:
+    static MonolayerMechanics* Get() {
+      static MonolayerMechanics monolayer;
+      return &monolayer;
+    }
+
+    void Enable(double layer_z, int start_clock = 1060) {
+      enabled_ = true;
+      layer_z_ = layer_z;
+      start_clock_ = start_clock;
+    }
+
+    bool IsEnabled() const { return enabled_; }
+
+    bool IsInLayer(int internal_clock) const {
+      return enabled_ && internal_clock >= start_clock_;
+    }
+
+    // in-plane equivalent of Cell::CalculateDisplacement
+    Double3 CalculateDisplacement(Cell* cell, double dt) {
+      auto& position = cell->GetPosition();
+      double radius = cell->GetDiameter() / 2;
+      SoUid uid = cell->GetUid();
+      Double3 force = {0, 0, 0};
+      objects_.ForEachWithin(position[0], position[1], radius + max_reach_,
+          [&](uint32_t i) {
+            auto& neighbor = object_list_[objects_.Payload(i)];
+            if (neighbor.uid == uid) { return; }
+            Double3 center = neighbor.position;
+            if (neighbor.is_neurite) {
+              // own primary elements
+              if (neighbor.mother == uid) { return; }
+              // closest point of the element axis
+              Double3 axis = neighbor.position - neighbor.proximal;
+              double squared_length =
+                  axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+              double t = 1;
+              if (squared_length > 0) {
+                Double3 d = position - neighbor.proximal;
+                t = (d[0] * axis[0] + d[1] * axis[1] + d[2] * axis[2]) /
+                    squared_length;
+                t = min(max(t, 0.0), 1.0);
+              }
+              center = neighbor.proximal + axis * t;
+            }
+            auto neighbor_force = ForceBetweenSpheres(
+                position, radius, center, neighbor.diameter / 2);
+            force[0] += neighbor_force[0];
+            force[1] += neighbor_force[1];
+          });
+
+      Double3 movement = cell->GetTractorForce() * dt;
+      movement[2] = 0;
+      // avoid huge jumps in the simulation
+      double max_displacement =
+          Simulation::GetActive()->GetParam()->simulation_max_displacement_;
+      double norm_of_force = sqrt(force[0] * force[0] + force[1] * force[1]);
+      if (norm_of_force > cell->GetAdherence()) {
+        double mh = dt / cell->GetMass();
+        movement = movement + force * mh;
+        double norm = sqrt(movement[0] * movement[0] +
+                           movement[1] * movement[1]);
+        if (norm > max_displacement) {
+          movement = movement * (max_displacement / norm);
+        }
+      }
+      // back to the layer, over several steps for somas still away from it
+      movement[2] = min(max(layer_z_ - position[2], -max_displacement),
+                        max_displacement);
+      return movement;
+    }
+
+    // hash of somas and neurite elements, rebuilt before each step
+    // (step_index.h)
+    void Clear(int thread_nb) override {
+      objects_.Clear();
+      object_list_.clear();
+      max_reach_ = 0;
+      thread_objects_.resize(thread_nb);
+      for (auto& objects : thread_objects_) {
+        objects.clear();
+      }
+    }
+
+    void Add(SimObject* so, int thread) override {
+      if (!enabled_) { return; }
+      Object object;
+      if (auto* ne = dynamic_cast<NeuriteElement*>(so)) {
+        object.proximal = ne->GetProximalEnd();
+        object.position = ne->GetDistalEnd();
+        object.mother = ne->GetMother().GetUid();
+        object.is_neurite = true;
+      } else if (dynamic_cast<NeuronSoma*>(so)) {
+        object.position = so->GetPosition();
+        object.is_neurite = false;
+      } else {
+        return;
+      }
+      object.diameter = so->GetDiameter();
+      object.uid = so->GetUid();
+      thread_objects_[thread].push_back(object);
+    }
+
+    void Build() override {
+      if (!enabled_) { return; }
+      for (auto& objects : thread_objects_) {
+        for (auto& object : objects) {
+          // neurite elements are hashed on their midpoint
+          Double3 center = object.position;
+          double reach = object.diameter / 2;
+          if (object.is_neurite) {
+            center = (object.proximal + object.position) * 0.5;
+            Double3 axis = object.position - object.proximal;
+            reach += sqrt(axis[0] * axis[0] + axis[1] * axis[1] +
+                          axis[2] * axis[2]) / 2;
+          }
+          objects_.Add(center[0], center[1], center[2], object_list_.size());
+          object_list_.push_back(object);
+          max_reach_ = max(max_reach_, reach);
+        }
+      }
+      objects_.Build(2 * max_reach_);
+    }
+
+   private:
+    struct Object {
+      // proximal end of neurite elements
+      Double3 proximal;
+      // soma position or neurite distal end
+      Double3 position;
+      double diameter;
+      SoUid uid;
+      // uid of the mother of neurite elements
+      SoUid mother;
+      bool is_neurite;
+    };
+
+    MonolayerMechanics() {}
+
+    // as DefaultForce between two spheres; force on the first one
+    static Double3 ForceBetweenSpheres(const Double3& a, double radius_a,
+                                       const Double3& b, double radius_b) {
+      Double3 ab = a - b;
+      double distance = sqrt(ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2]);
+      double delta = radius_a + radius_b - distance;
+      if (delta < 0 || distance < 1e-8) { return {0, 0, 0}; }
+      double k = 2, gamma = 1;
+      double r = radius_a * radius_b / (radius_a + radius_b);
+      double module = k * delta - gamma * sqrt(r * delta);
+      return ab * (module / distance);
+    }
+
+    bool enabled_ = false;
+    double layer_z_ = 27;
+    int start_clock_ = 1060;
+    double max_reach_ = 0;
+    SpatialHash2D objects_;
+    vector<Object> object_list_;
+    // objects added by each thread
+    vector<vector<Object>> thread_objects_;
+  };  // end MonolayerMechanics
+
+}  // namespace bdm
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef MOSAIC_MEASURES_
+#define MOSAIC_MEASURES_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "delaunay.h"
+#include "spatial_hash.h"
+
+namespace bdm {
+  using namespace std;
+
+  // Mosaic measures of one cell type, besides RI:
+  // - density recovery profile (Rodieck 1991): density of same-type cells in
+  //   annuli around each cell, counted through a 2D spatial hash up to
+  //   drp_bins * bin_width, so cost is linear in the number of cells
+  // - effective radius from the DRP and packing factor relative to a
+  //   perfect hexagonal mosaic of the same density
+  // - Voronoi domain regularity index (mean / std of domain areas) from an
+  //   incremental Delaunay triangulation, excluding domains touching the
+  //   border of the mosaic
+  struct MosaicStats {
+    int cell_type = -1;
+    size_t cell_nb = 0;
+    double density = 0;  // cells per um^2
+    double bin_width = 0;
+    vector<double> drp;
+    double effective_radius = 0;
+    double packing_factor = 0;
+    double voronoi_ri = 0;
+    double voronoi_mean_area = 0;
+  };  // end MosaicStats
+
+  // x, y: cell positions; field_area: area cells are spread over;
+  // drp_bins annuli of bin_width are computed (bin_width <= 0: a tenth of the
+  // mean distance between cells)
+  inline MosaicStats ComputeMosaicStats(const vector<double>& x,
+                                        const vector<double>& y,
+                                        double field_area, int drp_bins = 20,
+                                        double bin_width = 0) {
+    MosaicStats stats;
+    size_t n = x.size();
+    stats.cell_nb = n;
+    if (n < 3 || field_area <= 0) { return stats; }
+    stats.density = n / field_area;
+    if (bin_width <= 0) {
+      bin_width = 0.1 / sqrt(stats.density);
+    }
+    stats.bin_width = bin_width;
+    double max_radius = drp_bins * bin_width;
+
+    /* -- density recovery profile -- */
+    SpatialHash2D hash;
+    hash.Reserve(n);
+    double min_x = x[0], max_x = x[0], min_y = y[0], max_y = y[0];
+    for (size_t i = 0; i < n; i++) {
+      hash.Add(x[i], y[i], 0, i);
+      min_x = min(min_x, x[i]); max_x = max(max_x, x[i]);
+      min_y = min(min_y, y[i]); max_y = max(max_y, y[i]);
+    }
+    hash.Build(max_radius);
+    // reference cells far enough from the border to see full annuli; all
+    // cells if the field is too narrow or if no cell is that far from it
+    bool whole_field = max_x - min_x <= 2 * max_radius ||
+                       max_y - min_y <= 2 * max_radius;
+    vector<double> counts(drp_bins, 0);
+    size_t reference_nb = 0;
+    while (reference_nb == 0) {
+      for (size_t i = 0; i < n; i++) {
+        if (!whole_field &&
+            (x[i] - min_x < max_radius || max_x - x[i] < max_radius ||
+             y[i] - min_y < max_radius || max_y - y[i] < max_radius)) {
+          continue;
+        }
+        reference_nb++;
+        hash.ForEachWithin(x[i], y[i], max_radius, [&](uint32_t j) {
+          if (hash.Payload(j) == i) { return; }
+          double dx = hash.X(j) - x[i], dy = hash.Y(j) - y[i];
+          int bin = static_cast<int>(sqrt(dx * dx + dy * dy) / bin_width);
+          if (bin < drp_bins) { counts[bin]++; }
+        });
+      }
+      whole_field = true;
+    }
+    stats.drp.assign(drp_bins, 0);
+    for (int b = 0; b < drp_bins; b++) {
+      double annulus = M_PI * bin_width * bin_width * (2 * b + 1);
+      stats.drp[b] = counts[b] / (reference_nb * annulus);
+    }
+
+    // effective radius: radius of the empty disk that would hold the cells
+    // missing in the DRP before it reaches the mean density
+    double missing = 0;
+    for (int b = 0; b < drp_bins && stats.drp[b] < stats.density; b++) {
+      double annulus = M_PI * bin_width * bin_width * (2 * b + 1);
+      missing += (stats.density - stats.drp[b]) * annulus;
+    }
+    stats.effective_radius = sqrt(missing / (M_PI * stats.density));
+    double max_radius_hexagonal = sqrt(2 / (sqrt(3) * stats.density));
+    stats.packing_factor =
+        pow(stats.effective_radius / max_radius_hexagonal, 2);
+
+    /* -- Voronoi domains -- */
+    Delaunay2D delaunay;
+    delaunay.Triangulate(x, y);
+    double sum = 0, squared_sum = 0;
+    size_t domain_nb = 0;
+    for (size_t i = 0; i < n; i++) {
+      double area = delaunay.VoronoiArea(i);
+      if (area > 0) {
+        sum += area;
+        squared_sum += area * area;
+        domain_nb++;
+      }
+    }
+    if (domain_nb > 1) {
+      double mean = sum / domain_nb;
+      double std = sqrt(max(squared_sum / domain_nb - mean * mean, 0.0));
+      stats.voronoi_mean_area = mean;
+      stats.voronoi_ri = std > 0 ? mean / std : 0;
+    }
+    return stats;
+  }  // end ComputeMosaicStats
+
+}  // namespace bdm
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef MOSAIC_STATS_
+#define MOSAIC_STATS_
+
+#include "biodynamo.h"
+#include "extended_objects.h"
+#include "mosaic_measures.h"
+
+namespace bdm {
+  using namespace std;
+
+  // mosaic stats of every cell type (typed cells only) spread between min and
+  // max on x and y
+  inline vector<MosaicStats> GetAllMosaicStats(double min, double max) {
+    auto* rm = Simulation::GetActive()->GetResourceManager();
+    vector<int> types_list;
+    vector<vector<double>> xs, ys;
+    rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
+      auto* cell = dynamic_cast<MyCell*>(so);
+      if (cell && cell->GetCellType() != -1) {
+        auto it = find(types_list.begin(), types_list.end(),
+                       cell->GetCellType());
+        size_t t = it - types_list.begin();
+        if (it == types_list.end()) {
+          types_list.push_back(cell->GetCellType());
+          xs.emplace_back();
+          ys.emplace_back();
+        }
+        auto& position = cell->GetPosition();
+        xs[t].push_back(position[0]);
+        ys[t].push_back(position[1]);
+      }
+    });  // end for cell in simulation
+
+    vector<MosaicStats> all_stats(types_list.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t t = 0; t < types_list.size(); t++) {
+      all_stats[t] = ComputeMosaicStats(xs[t], ys[t],
+                                        (max - min) * (max - min));
+      all_stats[t].cell_type = types_list[t];
+    }
+    return all_stats;
+  }  // end GetAllMosaicStats
+
+}  // namespace bdm
+
+#endif
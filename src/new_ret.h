@@ -14,8 +14,14 @@
 #ifndef NEW_RET_H_
 #define NEW_RET_H_
 
+#include <chrono>
+#include <memory>
 #include "biodynamo.h"
+#include "domain_decomposition.h"
 #include "extended_objects.h"
+#include "lod_export.h"
+#include "memory_report.h"
+#include "mosaic_stats.h"
 #include "util_methods.h"
 
 namespace bdm {
@@ -27,18 +33,57 @@ inline int Simulate(int argc, const char** argv) {
   int num_cells = cell_density*((double)cube_dim/1000)*((double)cube_dim/1000);
   double diffusion_coef = 0.5;
   double decay_const = 0.1;
+  // kDiffusionGrid, kKernelSum or kCalibration (see substance_field.h)
+  auto field_mode = SubstanceField::kDiffusionGrid;
+  // kernels fitted by a kCalibration run (its kernel_calibration_<seed>.txt),
+  // required by kKernelSum: movement and death thresholds are grid based
+  string kernel_calibration = "kernel_calibration.txt";
+
+  // 2D in-plane mechanics of somas pulled into the layer at z=27 once the
+  // cell death phase is over (see monolayer.h)
+  bool monolayer_mechanics = false;
 
   bool write_ri = true;
+  bool write_mosaic_stats = true;
   bool write_positions = true;
   bool write_swc = true;
+  bool write_morphometrics = true;
+  bool write_memory_report = true;
+  // decimated visualization export (see lod_export.h); keep export = false in
+  // bdm.toml for large retinas
+  LodExportParam lod_export;
+  lod_export.enabled = false;
+  lod_export.frame_budget = 8 << 20;
+  lod_export.voxel_size = 0;
+  // live telemetry in shared memory, see tools/telemetry_viewer.cc
+  bool publish_telemetry = true;
   bool clean_result_dir = true;
 
+  // domain decomposition over tiles_x * tiles_y local processes, one x-y
+  // tile each (see domain_decomposition.h); NEW_RET_TILES=<x>x<y> overrides
+  int tiles_x = 1;
+  int tiles_y = 1;
+  // width of the border band exchanged with neighbour tiles
+  double halo = 50;
+  ReadTilesFromEnvironment(&tiles_x, &tiles_y);
+  ProcessGroup* group = nullptr;
+  if (tiles_x * tiles_y > 1) {
+    group = LaunchTiles(tiles_x, tiles_y);
+    // diffusion grids would cover the whole domain in every process, tiles
+    // use the kernel sums
+    field_mode = SubstanceField::kKernelSum;
+  }
+
   auto set_param = [&](Param* param) {
     // Create an artificial bounds for the simulation space
     param->bound_space_ = true;
     param->min_bound_ = 0;
     param->max_bound_ = cube_dim + 20;
     param->run_mechanical_interactions_ = true;
+    // one output folder per tile
+    if (group) {
+      param->output_dir_ = Concat(param->output_dir_, "/tile", group->GetRank());
+    }
   };
 
   // initialise neuroscience modlues
@@ -53,40 +98,95 @@ inline int Simulate(int argc, const char** argv) {
   int my_seed = rand() % 10000;
   // my_seed = 9408;
   random->SetSeed(my_seed);
-  cout << "Start simulation with " << cell_density
-       << " cells/mm^2 using seed " << my_seed << endl;
+
+  unique_ptr<DomainDecomposition> tiles;
+  if (group) {
+    tiles.reset(new DomainDecomposition(group,
+      TileLayout(tiles_x, tiles_y, param->min_bound_, param->max_bound_), halo));
+    // statistics of one tile would be biased by its edges
+    write_mosaic_stats = false;
+  }
+  bool is_root = !tiles || tiles->IsRoot();
+
+  if (is_root) {
+    cout << "Start simulation with " << cell_density
+         << " cells/mm^2 using seed " << my_seed << endl;
+  }
+
+  if (monolayer_mechanics) {
+    MonolayerMechanics::Get()->Enable(27);
+  }
 
   // create cells
-  CellCreator(param->min_bound_, param->max_bound_, num_cells, -1);
+  if (tiles) {
+    // every tile draws the same cells and keeps its own
+    CellCreator(param->min_bound_, param->max_bound_, num_cells, -1,
+                [&](const Double3& p) { return tiles->Owns(p); });
+    random->SetSeed(my_seed + 10000 * tiles->GetRank());
+  } else {
+    CellCreator(param->min_bound_, param->max_bound_, num_cells, -1);
+  }
+
+  auto* field = SubstanceField::Get();
+  field->SetMode(field_mode);
+  field->SetDiffusionParameters(diffusion_coef, decay_const,
+    (double)(param->max_bound_ - param->min_bound_)/(param->max_bound_/4));
+  if (field_mode == SubstanceField::kKernelSum &&
+      !field->ReadCalibration(kernel_calibration)) {
+    cout << "error: kernel sums need the kernels calibrated against the "
+         << "diffusion grids in " << kernel_calibration << endl;
+    if (group) {
+      group->Finalize();
+    }
+    return 1;
+  }
 
   // Order: substance_name, diffusion_coefficient, decay_constant, resolution
-  ModelInitializer::DefineSubstance(dg_200_, "off_aplhaa", diffusion_coef, decay_const, param->max_bound_/4);
-  ModelInitializer::DefineSubstance(dg_201_, "off_aplhab", diffusion_coef, decay_const, param->max_bound_/4);
-  ModelInitializer::DefineSubstance(dg_202_, "off_m1", diffusion_coef, decay_const, param->max_bound_/4);
-  ModelInitializer::DefineSubstance(dg_203_, "off_j", diffusion_coef, decay_const, param->max_bound_/4);
-  // ModelInitializer::DefineSubstance(dg_204_, "off_mini_j", diffusion_coef, decay_const, param->max_bound_/4);
-  // ModelInitializer::DefineSubstance(dg_205_, "off_midi_j", diffusion_coef, decay_const, param->max_bound_/4);
-  // ModelInitializer::DefineSubstance(dg_206_, "off_u", diffusion_coef, decay_const, param->max_bound_/4);
-  // ModelInitializer::DefineSubstance(dg_207_, "off_v", diffusion_coef, decay_const, param->max_bound_/4);
-  // ModelInitializer::DefineSubstance(dg_208_, "off_w", diffusion_coef, decay_const, param->max_bound_/4);
-  // ModelInitializer::DefineSubstance(dg_209_, "off_x", diffusion_coef, decay_const, param->max_bound_/4);
-  // ModelInitializer::DefineSubstance(dg_210_, "off_y", diffusion_coef, decay_const, param->max_bound_/4);
-  // ModelInitializer::DefineSubstance(dg_211_, "off_z", diffusion_coef, decay_const, param->max_bound_/4);
-
-  cout << "Cells created and substances initialised" << endl;
+  if (field->UseDiffusionGrid()) {
+    ModelInitializer::DefineSubstance(dg_200_, "off_aplhaa", diffusion_coef, decay_const, param->max_bound_/4);
+    ModelInitializer::DefineSubstance(dg_201_, "off_aplhab", diffusion_coef, decay_const, param->max_bound_/4);
+    ModelInitializer::DefineSubstance(dg_202_, "off_m1", diffusion_coef, decay_const, param->max_bound_/4);
+    ModelInitializer::DefineSubstance(dg_203_, "off_j", diffusion_coef, decay_const, param->max_bound_/4);
+    // ModelInitializer::DefineSubstance(dg_204_, "off_mini_j", diffusion_coef, decay_const, param->max_bound_/4);
+    // ModelInitializer::DefineSubstance(dg_205_, "off_midi_j", diffusion_coef, decay_const, param->max_bound_/4);
+    // ModelInitializer::DefineSubstance(dg_206_, "off_u", diffusion_coef, decay_const, param->max_bound_/4);
+    // ModelInitializer::DefineSubstance(dg_207_, "off_v", diffusion_coef, decay_const, param->max_bound_/4);
+    // ModelInitializer::DefineSubstance(dg_208_, "off_w", diffusion_coef, decay_const, param->max_bound_/4);
+    // ModelInitializer::DefineSubstance(dg_209_, "off_x", diffusion_coef, decay_const, param->max_bound_/4);
+    // ModelInitializer::DefineSubstance(dg_210_, "off_y", diffusion_coef, decay_const, param->max_bound_/4);
+    // ModelInitializer::DefineSubstance(dg_211_, "off_z", diffusion_coef, decay_const, param->max_bound_/4);
+  }
+
+  if (is_root) {
+    cout << "Cells created and substances initialised" << endl;
+  }
 
   // prepare export
   ofstream output_ri;
-  if ((write_ri || write_positions || write_swc) && system(
+  if ((write_ri || write_mosaic_stats || write_positions || write_swc
+       || write_morphometrics || write_memory_report || lod_export.enabled)
+      && system(
     Concat("mkdir -p ", param->output_dir_,
            "/results", my_seed).c_str())) {
       cout << "error during " << param->output_dir_
            << "/results folder creation" << endl;
   }
-  if (write_ri) {
+  if (write_ri && is_root) {
     output_ri.open(Concat(param->output_dir_, "/results", my_seed,
                           "/RI_" + to_string(my_seed) + ".txt"));
   }
+  ofstream output_mosaic, output_drp;
+  if (write_mosaic_stats) {
+    output_mosaic.open(Concat(param->output_dir_, "/results", my_seed,
+                              "/mosaic_stats_", my_seed, ".txt"));
+    output_drp.open(Concat(param->output_dir_, "/results", my_seed,
+                           "/drp_", my_seed, ".txt"));
+  }
+  ofstream output_memory;
+  if (write_memory_report) {
+    output_memory.open(Concat(param->output_dir_, "/results", my_seed,
+                              "/memory_", my_seed, ".txt"));
+  }
   if (write_positions && system(
     Concat("mkdir -p ", param->output_dir_,
            "/results", my_seed, "/cells_position").c_str())) {
@@ -100,27 +200,95 @@ inline int Simulate(int argc, const char** argv) {
            << "/results"<< my_seed <<"/swc_files folder creation" << endl;
   }
 
+  if (lod_export.enabled && system(
+    Concat("mkdir -p ", param->output_dir_,
+           "/results", my_seed, "/lod").c_str())) {
+      cout << "error during " << param->output_dir_
+           << "/results"<< my_seed <<"/lod folder creation" << endl;
+  }
+
+  unique_ptr<TelemetryPublisher> telemetry;
+  if (publish_telemetry && is_root) {
+    telemetry.reset(new TelemetryPublisher(my_seed));
+    if (telemetry->IsOpen()) {
+      ExportBufferBytes() += TelemetryPublisher::Bytes();
+    } else {
+      cout << "error during " << telemetry->GetName()
+           << " telemetry segment creation" << endl;
+    }
+  }
+
+  auto simulate = [&](int steps) {
+    if (tiles) {
+      tiles->Simulate(scheduler, steps);
+    } else {
+      SimulateSteps(scheduler, steps);
+    }
+  };
+
   // Run simulation
-  cout << "Simulating.." << endl;
+  if (is_root) {
+    cout << "Simulating.." << endl;
+  }
   for (int i = 0; i < max_step/160; i++) {
     // if we want to export data from simulation
-    if (write_ri || write_positions || write_swc) {
+    if (write_ri || write_mosaic_stats || write_positions || write_swc
+        || publish_telemetry || lod_export.enabled) {
       for (int repet = 0; repet < 10; repet++) {
-        scheduler->Simulate(16);
+        auto start = chrono::steady_clock::now();
+        simulate(16);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
         int current_step = 16+(16*repet)+(160*i);
 
-        if (write_ri) {
-          vector<array<double, 2>> all_ri = GetAllRI();
-          double death_rate = GetDeathRate(num_cells);
+        vector<array<double, 2>> all_ri;
+        double death_rate = 0;
+        vector<uint64_t> counts;
+        if ((write_ri || publish_telemetry) && tiles) {
+          all_ri = tiles->GetAllRI();
+          death_rate = tiles->GetDeathRate(num_cells);
+          if (publish_telemetry) {
+            counts = tiles->GetCellCounts(all_ri);
+          }
+        } else if (write_ri || publish_telemetry) {
+          all_ri = GetAllRI();
+          death_rate = GetDeathRate(num_cells);
+        }
+        if (publish_telemetry && is_root) {
+          PublishTelemetry(telemetry.get(), current_step, all_ri, death_rate,
+                           elapsed.count() / 16, counts);
+        }
+        if (write_ri && is_root) {
           for (unsigned int ri_i = 0; ri_i < all_ri.size(); ri_i++) {
             // step ri type death
             output_ri << current_step << " " << all_ri[ri_i][0]
                       << " " << all_ri[ri_i][1] << " " << death_rate << "\n";
           }
         }
+        if (write_mosaic_stats) {
+          vector<MosaicStats> all_stats =
+            GetAllMosaicStats(param->min_bound_ + 10, param->max_bound_ - 10);
+          for (auto& stats : all_stats) {
+            // step type cells density effective_radius packing_factor vdri
+            output_mosaic << current_step << " " << stats.cell_type << " "
+                          << stats.cell_nb << " " << stats.density << " "
+                          << stats.effective_radius << " "
+                          << stats.packing_factor << " "
+                          << stats.voronoi_ri << "\n";
+            // step type bin_width density_per_bin...
+            output_drp << current_step << " " << stats.cell_type << " "
+                       << stats.bin_width;
+            for (double density : stats.drp) {
+              output_drp << " " << density;
+            }
+            output_drp << "\n";
+          }
+        }
         if (write_positions) {
           WritePositions(current_step, my_seed);
         }
+        if (lod_export.enabled) {
+          WriteLodFrame(lod_export, current_step, my_seed);
+        }
         if (false && write_swc) {
           WriteSwc(current_step, my_seed);
         }
@@ -128,30 +296,60 @@ inline int Simulate(int argc, const char** argv) {
     } // if export data
 
     else {
-      scheduler->Simulate(160);
+      simulate(160);
     }
 
-   vector<array<double, 2>> all_ri = GetAllRI();
+   if (write_memory_report) {
+     WriteMemoryReport(output_memory, 160*(i+1));
+     output_memory.flush();
+   }
+
+   vector<array<double, 2>> all_ri = tiles ? tiles->GetAllRI() : GetAllRI();
+   double death_rate = tiles ? tiles->GetDeathRate(num_cells)
+                             : GetDeathRate(num_cells);
    double mean_ri = 0;
    for (unsigned int i = 0; i < all_ri.size(); i++) {
      mean_ri += all_ri[i][0];
    }
-   cout << setprecision(3)
-        << "Day " << i+1 << "/" << (int)max_step/160 << " simulated:\n"
-        << "Average ri = " << (double)mean_ri/all_ri.size() << " ; "
-        << GetDeathRate(num_cells) << "% of cell death"<< endl;
+   if (is_root) {
+     cout << setprecision(3)
+          << "Day " << i+1 << "/" << (int)max_step/160 << " simulated:\n"
+          << "Average ri = " << (double)mean_ri/all_ri.size() << " ; "
+          << death_rate << "% of cell death"<< endl;
+   }
    //TODO delete all "mosaic" substances in simulation after mosaics are done
    // if (i > 2100) {
    //   delete [substances];
    // }
   }
 
+  if (field_mode == SubstanceField::kCalibration) {
+    field->WriteCalibration(Concat(param->output_dir_, "/results", my_seed,
+                                   "/kernel_calibration_", my_seed, ".txt"));
+    cout << "Substance kernels calibrated" << endl;
+  }
+
   if (write_swc) {
     WriteSwc(max_step, my_seed);
-    std::cout << "Morphologies exported (swc files)" << std::endl;
+    if (is_root) {
+      std::cout << "Morphologies exported (swc files)" << std::endl;
+    }
+  }
+  if (write_morphometrics) {
+    WriteMorphometrics(max_step, my_seed);
+    if (is_root) {
+      std::cout << "Morphometrics exported" << std::endl;
+    }
   }
 
-  cout << "Done" << endl;
+  if (tiles) {
+    tiles->Finalize();
+  }
+  if (is_root) {
+    cout << "Step index rebuilds took " << StepIndex::GetUpdateSeconds()
+         << " s" << endl;
+    cout << "Done" << endl;
+  }
   return 0;
 } // end Simulate
 
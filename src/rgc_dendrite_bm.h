@@ -2,24 +2,121 @@
 #define RGC_DENDRITE_BM_
 
 #include "biodynamo.h"
+#include "dendrite_hash.h"
+#include "extended_objects.h"
+#include "module_pool.h"
 
 namespace bdm {
 using namespace std;
 
 
-// Define rgc dendrite behavior
+// Define rgc dendrite behavior: elongation, branching and homotypic tiling.
+// Only terminal elements grow. A terminal touching a dendrite from another
+// cell of the same subtype retracts until it is out of contact, then stops
+// growing for good (beyond threshold): arbors of the same type tile.
 struct RGC_dendrite_BM : public BaseBiologyModule {
   BDM_STATELESS_BM_HEADER(RGC_dendrite_BM, BaseBiologyModule, 1);
 
 public:
+  POOLED_BM_ALLOCATOR(RGC_dendrite_BM);
   RGC_dendrite_BM() : BaseBiologyModule(gAllEventIds) {}
 
   void Run(SimObject* so) override {
     if (auto* ne = dynamic_cast<MyNeurite*>(so)) {
+      if (!ne->IsTerminal()) { return; }
       auto* sim = Simulation::GetActive();
       auto* random = sim->GetRandom();
+      auto* segments = DendriteSegmentHash::Get();
 
-      ne->GetMySoma()->GetLabel();
+      int subtype = ne->GetSubtype();
+      double growth_speed = 100;
+      double branching_proba = 0.005;
+      double shrinkage = 0.0005;
+      double min_diameter = 0.4;
+      double branching_length = 5;
+      double contact_distance = 2;
+      double retraction_speed = 50;
+
+      // arbor size depending on cell type
+      if (subtype == 200 || subtype == 201) {
+        // alpha cells: large sparse arbors
+        branching_proba = 0.004;
+        shrinkage = 0.0003;
+      }
+      else if (subtype == 202) {
+        branching_proba = 0.003;
+        shrinkage = 0.0004;
+      }
+      else if (subtype == 203) {
+        branching_proba = 0.006;
+        shrinkage = 0.0006;
+      }
+
+      // homotypic dendrites in contact with this terminal end
+      auto distal = ne->GetDistalEnd();
+      int contacts = 0;
+      Double3 repulsion = {0, 0, 0};
+      segments->ForEachHomotypicSegment(subtype, ne->GetMySoma()->GetUid(),
+        distal, 2 * contact_distance,
+        [&](const Double3& closest, double squared_distance) {
+          if (squared_distance < contact_distance * contact_distance) {
+            contacts++;
+          }
+          double distance = sqrt(squared_distance);
+          if (distance > 0) {
+            repulsion = repulsion + (distal - closest) * (1 / distance);
+          }
+        });
+
+      /* -- retraction -- */
+      if (ne->GetHasToRetract()) {
+        if (contacts == 0) {
+          // out of contact: stop here and get back to previous diameter
+          ne->SetHasToRetract(false);
+          ne->SetBeyondThreshold(true);
+          ne->SetDiameter(ne->GetDiamBeforeRetraction());
+        }
+        else {
+          ne->RetractTerminalEnd(retraction_speed);
+        }
+        return;
+      }
+      if (contacts != 0 && !ne->GetBeyondThreshold()) {
+        ne->SetHasToRetract(true);
+        ne->SetDiamBeforeRetraction(ne->GetDiameter());
+        ne->SetDiameter(ne->GetDiameter() * 0.5);
+        return;
+      }
+      if (ne->GetBeyondThreshold() || ne->GetDiameter() < min_diameter) {
+        return;
+      }
+
+      /* -- elongation -- */
+      // dendrites stratify: growth stays in the x-y plane
+      Double3 direction = ne->GetSpringAxis();
+      direction[2] = 0;
+      double norm = direction.Norm();
+      if (norm < 1e-3) {
+        // dendrite root points toward the IPL: pick a planar direction
+        double angle = random->Uniform(0, 2 * Math::kPi);
+        direction = {cos(angle), sin(angle), 0};
+      }
+      else {
+        direction = direction * (1 / norm);
+      }
+      direction = direction + repulsion * 0.5 +
+        Double3({random->Uniform(-0.3, 0.3), random->Uniform(-0.3, 0.3), 0});
+      direction[2] = 0;
+      if (direction.Norm() == 0) { return; }
+      ne->ElongateTerminalEnd(growth_speed, direction);
+      ne->SetDiameter(ne->GetDiameter() * (1 - shrinkage));
+
+      /* -- branching -- */
+      if (ne->GetLength() > branching_length
+          && random->Uniform(0, 1) < branching_proba) {
+        Double3 side = {-direction[1], direction[0], 0};
+        ne->Bifurcate(direction + side * 0.7, direction - side * 0.7);
+      }
 
     } // end if MyNeurite
   } // end Run()
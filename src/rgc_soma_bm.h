@@ -3,7 +3,9 @@
 
 #include "biodynamo.h"
 #include "extended_objects.h"
+#include "module_pool.h"
 #include "rgc_dendrite_bm.h"
+#include "substance_field.h"
 
 namespace bdm {
 
@@ -17,20 +19,20 @@ namespace bdm {
     BDM_STATELESS_BM_HEADER(RGC_mosaic_BM, BaseBiologyModule, 1);
 
   public:
+    POOLED_BM_ALLOCATOR(RGC_mosaic_BM);
     RGC_mosaic_BM() : BaseBiologyModule(gAllEventIds) {}
 
     void Run(SimObject* so) override {
       if (auto* cell = dynamic_cast<MyCell*>(so)) {
         auto* sim = Simulation::GetActive();
-        auto* rm = sim->GetResourceManager();
         auto* random = sim->GetRandom();
+        auto* field = SubstanceField::Get();
 
         auto& position = cell->GetPosition();
         int cell_clock = cell->GetInternalClock();
         int cell_type = cell->GetCellType();
         double concentration = 0;
         Double3 gradient, diff_gradient, gradient_z;
-        DiffusionGrid* dg = nullptr;
 
         bool with_movement = true;
         double movement_threshold = 1.735;
@@ -77,14 +79,12 @@ namespace bdm {
           };
 
           // density to obtain: 114, 114, 185, 571
-          array<string, 4> substances_list = { "off_aplhaa", "off_aplhab", "off_m1", "off_j" };
-          array<int, 4> cells_types = { 200, 201, 202, 203 };
           array<double, 4> proba = { 0.115, 0.115, 0.188, 0.58 };
           vector<conc_type> conc_type_list;
-          for (size_t i=0; i < substances_list.size(); i++) {
-            dg = rm->GetDiffusionGrid(substances_list[i]);
-            double concentration = dg->GetConcentration(position);
-            conc_type_list.push_back(conc_type(concentration, cells_types[i], proba[i]) );
+          for (size_t i=0; i < kSecretingTypes.size(); i++) {
+            double concentration =
+              field->GetConcentration(kSecretingTypes[i], position);
+            conc_type_list.push_back(conc_type(concentration, kSecretingTypes[i], proba[i]) );
           }
 
           double concentration_threshold = 1e-3;
@@ -128,31 +128,27 @@ namespace bdm {
         } // end cell fate
 
         /* -- initialisation -- */
-        // use corresponding diffusion grid
         // set thresholds depending on initial density to obtain ~65% death rate
         if (cell_type == 200) {
-          dg = rm->GetDiffusionGrid("off_aplhaa");
           movement_threshold = 1.7;
           death_threshold = 1.79;
         }
         else if (cell_type == 201) {
-          dg = rm->GetDiffusionGrid("off_aplhab");
           movement_threshold = 1.7;
           death_threshold = 1.79;
         }
         else if (cell_type == 202) {
-          dg = rm->GetDiffusionGrid("off_m1");
           movement_threshold = 1.71;
           death_threshold = 1.78;
         }
         else if (cell_type == 203) {
-          dg = rm->GetDiffusionGrid("off_j");
           movement_threshold = 1.727;
           death_threshold = 1.772;
         }
 
-        dg->GetGradient(position, &gradient);
-        concentration = dg->GetConcentration(position);
+        // use corresponding homotypic substance
+        field->GetGradient(cell_type, position, &gradient);
+        concentration = field->GetConcentration(cell_type, position);
         if (position[2]>27) {gradient_z={0, 0, -0.01};}
         else {gradient_z={0, 0, 0.01};}
         diff_gradient = gradient * -0.1; diff_gradient[2] = 0;
@@ -178,12 +174,14 @@ namespace bdm {
             // cell movement based on homotype substance gradient
             cell->UpdatePosition(diff_gradient);
             // update distance travelled by this cell
-            auto previous_position = cell->GetPreviousPosition();
-            auto current_position = cell->GetPosition();
-            cell->SetDistanceTravelled(cell->GetDistanceTravelled() +
-            (sqrt(pow(current_position[0] - previous_position[0], 2) +
-            pow(current_position[1] - previous_position[1], 2))));
-            cell->SetPreviousPosition(cell->GetPosition());
+            if (MyCell::kTrackMigration) {
+              auto previous_position = cell->GetPreviousPosition();
+              auto current_position = cell->GetPosition();
+              cell->SetDistanceTravelled(cell->GetDistanceTravelled() +
+              (sqrt(pow(current_position[0] - previous_position[0], 2) +
+              pow(current_position[1] - previous_position[1], 2))));
+              cell->SetPreviousPosition(cell->GetPosition());
+            }
           }  // end tangential migration
 
           /* -- cell death -- */
@@ -213,32 +211,18 @@ namespace bdm {
     BDM_STATELESS_BM_HEADER(Substance_secretion_BM, BaseBiologyModule, 1);
 
   public:
+    POOLED_BM_ALLOCATOR(Substance_secretion_BM);
     Substance_secretion_BM() : BaseBiologyModule(gAllEventIds) {}
 
     void Run(SimObject* so) override {
       if (auto* cell = dynamic_cast<MyCell*>(so)) {
-        auto* rm = Simulation::GetActive()->GetResourceManager();
-
         if (cell->GetCellType() == -1) { return; }
         int cell_type = cell->GetCellType();
-        DiffusionGrid* dg = nullptr;
-        // use corresponding diffusion grid
-        if (cell_type == 200) {
-          dg = rm->GetDiffusionGrid("off_aplhaa");
-        }
-        if (cell_type == 201) {
-          dg = rm->GetDiffusionGrid("off_aplhab");
-        }
-        if (cell_type == 202) {
-          dg = rm->GetDiffusionGrid("off_m1");
-        }
-        if (cell_type == 203) {
-          dg = rm->GetDiffusionGrid("off_j");
-        }
 
+        // secrete corresponding homotypic substance
         if (cell->GetInternalClock()%3==0) {
           auto& secretion_position = cell->GetPosition();
-          dg->IncreaseConcentrationBy(secretion_position, 1);
+          SubstanceField::Get()->Secrete(cell_type, secretion_position, 1);
         }
 
         // remove Substance_secretion_BM when mosaics are over
@@ -256,6 +240,7 @@ namespace bdm {
     BDM_STATELESS_BM_HEADER(Internal_clock_BM, BaseBiologyModule, 1);
 
   public:
+    POOLED_BM_ALLOCATOR(Internal_clock_BM);
     Internal_clock_BM() : BaseBiologyModule(gAllEventIds) {}
 
     void Run(SimObject* so) override {
@@ -283,6 +268,7 @@ namespace bdm {
     BDM_STATELESS_BM_HEADER(Dendrite_creation_BM, BaseBiologyModule, 1);
 
   public:
+    POOLED_BM_ALLOCATOR(Dendrite_creation_BM);
     Dendrite_creation_BM() : BaseBiologyModule(gAllEventIds) {}
 
     void Run(SimObject* so) override {
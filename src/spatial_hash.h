@@ -0,0 +1,120 @@
+#ifndef SPATIAL_HASH_
+#define SPATIAL_HASH_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace bdm {
+
+  // Uniform grid over the x-y plane, rebuilt from scratch when positions
+  // change. The retina is a thin sheet, so hashing on x-y only keeps every
+  // bucket short while a query still visits a handful of buckets.
+  // Entries are sorted by bucket (counting sort) so that a query walks
+  // contiguous memory.
+  class SpatialHash2D {
+   public:
+    void Clear() {
+      in_x_.clear(); in_y_.clear(); in_z_.clear(); in_payload_.clear();
+    }
+
+    void Reserve(size_t n) {
+      in_x_.reserve(n); in_y_.reserve(n);
+      in_z_.reserve(n); in_payload_.reserve(n);
+    }
+
+    void Add(double x, double y, double z, uint32_t payload) {
+      in_x_.push_back(x); in_y_.push_back(y);
+      in_z_.push_back(z); in_payload_.push_back(payload);
+    }
+
+    // sort all added entries into buckets of size bucket_length
+    void Build(double bucket_length) {
+      size_t n = in_x_.size();
+      bucket_length_ = bucket_length > 0 ? bucket_length : 1;
+      min_x_ = 0; min_y_ = 0; nx_ = 1; ny_ = 1;
+      if (n != 0) {
+        double max_x = in_x_[0], max_y = in_y_[0];
+        min_x_ = in_x_[0]; min_y_ = in_y_[0];
+        for (size_t i = 1; i < n; i++) {
+          min_x_ = std::min(min_x_, in_x_[i]); max_x = std::max(max_x, in_x_[i]);
+          min_y_ = std::min(min_y_, in_y_[i]); max_y = std::max(max_y, in_y_[i]);
+        }
+        nx_ = static_cast<int>((max_x - min_x_) / bucket_length_) + 1;
+        ny_ = static_cast<int>((max_y - min_y_) / bucket_length_) + 1;
+      }
+
+      bucket_start_.assign(static_cast<size_t>(nx_) * ny_ + 1, 0);
+      vector_bucket_.resize(n);
+      for (size_t i = 0; i < n; i++) {
+        vector_bucket_[i] = BucketIndex(Coord(in_x_[i], min_x_, nx_),
+                                        Coord(in_y_[i], min_y_, ny_));
+        bucket_start_[vector_bucket_[i] + 1]++;
+      }
+      for (size_t b = 1; b < bucket_start_.size(); b++) {
+        bucket_start_[b] += bucket_start_[b - 1];
+      }
+
+      x_.resize(n); y_.resize(n); z_.resize(n); payload_.resize(n);
+      std::vector<uint32_t> next(bucket_start_.begin(), bucket_start_.end() - 1);
+      for (size_t i = 0; i < n; i++) {
+        uint32_t j = next[vector_bucket_[i]]++;
+        x_[j] = in_x_[i]; y_[j] = in_y_[i];
+        z_[j] = in_z_[i]; payload_[j] = in_payload_[i];
+      }
+    }
+
+    // call f(index) for every entry whose x-y distance to (x, y) can be lower
+    // than radius. Candidates are filtered on the squared x-y distance.
+    template <typename F>
+    void ForEachWithin(double x, double y, double radius, F&& f) const {
+      if (x_.empty()) { return; }
+      double squared_radius = radius * radius;
+      int x0 = Coord(x - radius, min_x_, nx_), x1 = Coord(x + radius, min_x_, nx_);
+      int y0 = Coord(y - radius, min_y_, ny_), y1 = Coord(y + radius, min_y_, ny_);
+      for (int by = y0; by <= y1; by++) {
+        for (int bx = x0; bx <= x1; bx++) {
+          uint32_t b = BucketIndex(bx, by);
+          for (uint32_t i = bucket_start_[b]; i < bucket_start_[b + 1]; i++) {
+            double dx = x_[i] - x, dy = y_[i] - y;
+            if (dx * dx + dy * dy <= squared_radius) {
+              f(i);
+            }
+          }
+        }
+      }
+    }
+
+    size_t size() const { return x_.size(); }
+    double X(uint32_t i) const { return x_[i]; }
+    double Y(uint32_t i) const { return y_[i]; }
+    double Z(uint32_t i) const { return z_[i]; }
+    uint32_t Payload(uint32_t i) const { return payload_[i]; }
+
+   private:
+    int Coord(double v, double min, int n) const {
+      int c = static_cast<int>(std::floor((v - min) / bucket_length_));
+      return std::min(std::max(c, 0), n - 1);
+    }
+
+    uint32_t BucketIndex(int bx, int by) const {
+      return static_cast<uint32_t>(by) * nx_ + bx;
+    }
+
+    double bucket_length_ = 1;
+    double min_x_ = 0, min_y_ = 0;
+    int nx_ = 1, ny_ = 1;
+    std::vector<uint32_t> bucket_start_;
+    std::vector<uint32_t> vector_bucket_;
+    // entries as added
+    std::vector<double> in_x_, in_y_, in_z_;
+    std::vector<uint32_t> in_payload_;
+    // entries sorted by bucket
+    std::vector<double> x_, y_, z_;
+    std::vector<uint32_t> payload_;
+  };  // end SpatialHash2D
+
+}  // namespace bdm
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef STEP_INDEX_
+#define STEP_INDEX_
+
+#include <omp.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "biodynamo.h"
+
+namespace bdm {
+
+  // Index of simulation objects read by biology modules and mechanics during
+  // a step (substance secretors, dendrite segments, monolayer somas...).
+  // Indexes register themselves when created; StepIndex::UpdateAll rebuilds
+  // all of them between two steps, so that the threads running modules only
+  // ever read them: objects are added in parallel, each thread to its own
+  // buffers, which Build merges.
+  class StepIndex {
+   public:
+    StepIndex() { Registry().push_back(this); }
+
+    virtual ~StepIndex() {
+      auto& registry = Registry();
+      registry.erase(std::remove(registry.begin(), registry.end(), this),
+                     registry.end());
+    }
+
+    StepIndex(const StepIndex&) = delete;
+    StepIndex& operator=(const StepIndex&) = delete;
+
+    // empty the index and its thread_nb per-thread buffers
+    virtual void Clear(int thread_nb) = 0;
+    // called concurrently; thread is the buffer of the calling thread
+    virtual void Add(SimObject* so, int thread) = 0;
+    virtual void Build() = 0;
+
+    static void UpdateAll() {
+      auto& registry = Registry();
+      if (registry.empty()) { return; }
+      auto start = std::chrono::steady_clock::now();
+      int thread_nb = omp_get_max_threads();
+      for (auto* index : registry) {
+        index->Clear(thread_nb);
+      }
+      Simulation::GetActive()->GetResourceManager()->ApplyOnAllElementsParallel(
+          [&](SimObject* so) {
+            int thread = omp_get_thread_num();
+            for (auto* index : registry) {
+              index->Add(so, thread);
+            }
+          });
+      for (auto* index : registry) {
+        index->Build();
+      }
+      UpdateSeconds() += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+    }
+
+    // wall time spent in UpdateAll so far
+    static double GetUpdateSeconds() { return UpdateSeconds(); }
+
+   private:
+    static double& UpdateSeconds() {
+      static double seconds = 0;
+      return seconds;
+    }
+
+    static std::vector<StepIndex*>& Registry() {
+      static std::vector<StepIndex*> registry;
+      return registry;
+    }
+  };  // end StepIndex
+
+}  // namespace bdm
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef SUBSTANCE_FIELD_
+#define SUBSTANCE_FIELD_
+
+#include <mutex>
+#include "biodynamo.h"
+#include "extended_objects.h"
+#include "spatial_hash.h"
+#include "step_index.h"
+
+namespace bdm {
+  using namespace std;
+
+  // homotypic substance secreted by each cell type
+  static const array<int, 4> kSecretingTypes = { 200, 201, 202, 203 };
+  static const array<string, 4> kSubstanceNames = {
+    "off_aplhaa", "off_aplhab", "off_m1", "off_j" };
+
+  inline int SubstanceIndex(int cell_type) {
+    for (size_t i = 0; i < kSecretingTypes.size(); i++) {
+      if (kSecretingTypes[i] == cell_type) { return i; }
+    }
+    return -1;
+  }
+
+  // Homotypic substances are only used as a short range "how crowded are
+  // same-type cells here" signal. SubstanceField gives RGC_mosaic_BM and
+  // Substance_secretion_BM one access point and can answer from:
+  // - kDiffusionGrid: the BioDynaMo diffusion grids (one 3D solve per
+  //   substance per step)
+  // - kKernelSum: a truncated sum of steady-state diffusion/decay kernels
+  //   scale * exp(-r / decay_length) / r from nearby same-type secreting
+  //   cells, found through a per-type spatial hash rebuilt before each step
+  //   (step_index.h).
+  //   No diffusion grid is needed, cost scales with the number of secretors.
+  // - kCalibration: answers from the diffusion grids, but also evaluates the
+  //   kernel sums for a range of decay lengths at every query and fits the
+  //   scale that best matches the grid. WriteCalibration() reports the fit,
+  //   which ReadCalibration() loads in kKernelSum runs so that they reuse
+  //   the grid based thresholds.
+  class SubstanceField : public StepIndex {
+   public:
+    enum Mode { kDiffusionGrid, kKernelSum, kCalibration };
+
+    static SubstanceField* Get() {
+      static SubstanceField field;
+      return &field;
+    }
+
+    void SetMode(Mode mode) { mode_ = mode; }
+    Mode GetMode() const { return mode_; }
+    bool UseDiffusionGrid() const { return mode_ != kKernelSum; }
+
+    // derive default kernels from the parameters given to DefineSubstance.
+    // In the grid, a box keeps 1-dc of its content and gives dc/6 to each
+    // neighbour, so the continuous equivalent is D = dc*h^2/6 for a box
+    // length h. The steady-state of a point source q is then
+    // q*h^3/(4*pi*D*r) * exp(-r*sqrt(decay/D)) in grid concentration units.
+    void SetDiffusionParameters(double diffusion_coef, double decay_const,
+                                double box_length) {
+      double decay_length =
+          box_length * sqrt(diffusion_coef / (6 * decay_const));
+      double scale = 6 * kSecretionRate * box_length /
+                     (4 * Math::kPi * diffusion_coef);
+      for (size_t i = 0; i < kSubstanceNames.size(); i++) {
+        SetKernel(i, scale, decay_length);
+      }
+      core_radius_ = box_length / 2;
+    }
+
+    void SetKernel(size_t substance, double scale, double decay_length) {
+      scale_[substance] = scale;
+      decay_length_[substance] = decay_length;
+    }
+
+    // distance under which kernels are not singular anymore
+    void SetCoreRadius(double r) { core_radius_ = r; }
+
+    double GetConcentration(int cell_type, const Double3& position) {
+      int s = SubstanceIndex(cell_type);
+      if (mode_ == kKernelSum) {
+        return KernelConcentration(s, scale_[s], decay_length_[s], position);
+      }
+      auto* rm = Simulation::GetActive()->GetResourceManager();
+      double concentration =
+          rm->GetDiffusionGrid(kSubstanceNames[s])->GetConcentration(position);
+      if (mode_ == kCalibration) {
+        Calibrate(s, concentration, position);
+      }
+      return concentration;
+    }
+
+    void GetGradient(int cell_type, const Double3& position,
+                     Double3* gradient) {
+      int s = SubstanceIndex(cell_type);
+      if (mode_ == kKernelSum) {
+        KernelGradient(s, position, gradient);
+        return;
+      }
+      auto* rm = Simulation::GetActive()->GetResourceManager();
+      rm->GetDiffusionGrid(kSubstanceNames[s])->GetGradient(position, gradient);
+    }
+
+    // secretors are collected from cell types for the kernel sums
+    void Secrete(int cell_type, const Double3& position, double quantity) {
+      if (mode_ == kKernelSum) { return; }
+      auto* rm = Simulation::GetActive()->GetResourceManager();
+      int s = SubstanceIndex(cell_type);
+      rm->GetDiffusionGrid(kSubstanceNames[s])
+          ->IncreaseConcentrationBy(position, quantity);
+    }
+
+    // substance decay_length scale rmse samples
+    void WriteCalibration(const string& file_name) {
+      lock_guard<mutex> lock(mutex_);
+      ofstream output(file_name);
+      for (size_t s = 0; s < kSubstanceNames.size(); s++) {
+        size_t best = 0;
+        double best_residual = numeric_limits<double>::max();
+        for (size_t c = 0; c < kCandidates; c++) {
+          auto& fit = fits_[s][c];
+          if (fit.kk == 0) { continue; }
+          double residual = fit.gg - fit.gk * fit.gk / fit.kk;
+          if (residual < best_residual) {
+            best_residual = residual;
+            best = c;
+          }
+        }
+        auto& fit = fits_[s][best];
+        if (fit.kk == 0) { continue; }
+        output << kSubstanceNames[s] << " "
+               << decay_length_[s] * CandidateFactor(best) << " "
+               << fit.gk / fit.kk << " "
+               << sqrt(max(best_residual, 0.0) / fit.n) << " " << fit.n
+               << "\n";
+      }
+      output.close();
+    }
+
+    // kernels of a WriteCalibration file; false unless every substance has
+    // one
+    bool ReadCalibration(const string& file_name) {
+      ifstream input(file_name);
+      array<bool, 4> calibrated;
+      calibrated.fill(false);
+      string name;
+      double decay_length, scale, rmse;
+      size_t n;
+      while (input >> name >> decay_length >> scale >> rmse >> n) {
+        auto it = find(kSubstanceNames.begin(), kSubstanceNames.end(), name);
+        if (it == kSubstanceNames.end() || scale <= 0 || decay_length <= 0) {
+          continue;
+        }
+        size_t s = it - kSubstanceNames.begin();
+        SetKernel(s, scale, decay_length);
+        calibrated[s] = true;
+      }
+      return all_of(calibrated.begin(), calibrated.end(),
+                    [](bool c) { return c; });
+    }
+
+    // secretor hashes, rebuilt before each step (step_index.h)
+    void Clear(int thread_nb) override {
+      for (auto& hash : secretors_) {
+        hash.Clear();
+      }
+      thread_secretors_.resize(thread_nb);
+      for (auto& secretors : thread_secretors_) {
+        for (auto& positions : secretors) {
+          positions.clear();
+        }
+      }
+    }
+
+    void Add(SimObject* so, int thread) override {
+      if (mode_ == kDiffusionGrid) { return; }
+      auto* cell = dynamic_cast<MyCell*>(so);
+      if (cell && cell->GetInternalClock() <= kSecretionEndClock) {
+        int s = SubstanceIndex(cell->GetCellType());
+        if (s != -1) {
+          thread_secretors_[thread][s].push_back(cell->GetPosition());
+        }
+      }
+    }
+
+    void Build() override {
+      for (auto& secretors : thread_secretors_) {
+        for (size_t s = 0; s < secretors.size(); s++) {
+          for (auto& p : secretors[s]) {
+            secretors_[s].Add(p[0], p[1], p[2], 0);
+          }
+        }
+      }
+      for (size_t s = 0; s < secretors_.size(); s++) {
+        double max_length = decay_length_[s];
+        if (mode_ == kCalibration) {
+          max_length *= CandidateFactor(kCandidates - 1);
+        }
+        secretors_[s].Build(kCutoff * max_length);
+      }
+    }
+
+   private:
+    // one unit on the steps where the clock is a multiple of 3: a clock
+    // value lasts as many steps whatever the tick probability, so a third
+    // of the steps
+    static constexpr double kSecretionRate = 1.0 / 3;
+    // cells stop secreting when Substance_secretion_BM is removed
+    static constexpr int kSecretionEndClock = 2020;
+    // kernels are truncated at kCutoff decay lengths (exp(-6) = 0.25%)
+    static constexpr double kCutoff = 6;
+    // decay lengths tried during calibration, relative to the default one
+    static constexpr size_t kCandidates = 9;
+    static double CandidateFactor(size_t c) {
+      static const array<double, kCandidates> factors = {
+        0.25, 0.35, 0.5, 0.7, 1, 1.4, 2, 2.8, 4 };
+      return factors[c];
+    }
+
+    struct Fit {
+      double gk = 0, kk = 0, gg = 0;
+      size_t n = 0;
+    };
+
+    SubstanceField() {
+      scale_.fill(1);
+      decay_length_.fill(4);
+    }
+
+    double KernelConcentration(int s, double scale, double decay_length,
+                               const Double3& position) const {
+      double concentration = 0;
+      auto& hash = secretors_[s];
+      hash.ForEachWithin(position[0], position[1], kCutoff * decay_length,
+          [&](uint32_t i) {
+            double dx = hash.X(i) - position[0];
+            double dy = hash.Y(i) - position[1];
+            double dz = hash.Z(i) - position[2];
+            double r = max(sqrt(dx * dx + dy * dy + dz * dz), core_radius_);
+            concentration += exp(-r / decay_length) / r;
+          });
+      return scale * concentration;
+    }
+
+    void KernelGradient(int s, const Double3& position,
+                        Double3* gradient) const {
+      double decay_length = decay_length_[s];
+      Double3 sum = {0, 0, 0};
+      auto& hash = secretors_[s];
+      hash.ForEachWithin(position[0], position[1], kCutoff * decay_length,
+          [&](uint32_t i) {
+            double dx = position[0] - hash.X(i);
+            double dy = position[1] - hash.Y(i);
+            double dz = position[2] - hash.Z(i);
+            double r = sqrt(dx * dx + dy * dy + dz * dz);
+            // flat inside the core radius
+            if (r <= core_radius_) { return; }
+            // d/dr exp(-r/l)/r = -exp(-r/l) * (1/(l*r) + 1/r^2)
+            double dcdr =
+                -exp(-r / decay_length) * (1 / (decay_length * r) + 1 / (r * r));
+            sum[0] += dcdr * dx / r;
+            sum[1] += dcdr * dy / r;
+            sum[2] += dcdr * dz / r;
+          });
+      *gradient = sum * scale_[s];
+    }
+
+    void Calibrate(int s, double grid_concentration, const Double3& position) {
+      array<double, kCandidates> kernel;
+      for (size_t c = 0; c < kCandidates; c++) {
+        kernel[c] = KernelConcentration(
+            s, 1, decay_length_[s] * CandidateFactor(c), position);
+      }
+      lock_guard<mutex> lock(mutex_);
+      for (size_t c = 0; c < kCandidates; c++) {
+        auto& fit = fits_[s][c];
+        fit.gk += grid_concentration * kernel[c];
+        fit.kk += kernel[c] * kernel[c];
+        fit.gg += grid_concentration * grid_concentration;
+        fit.n++;
+      }
+    }
+
+    Mode mode_ = kDiffusionGrid;
+    array<double, 4> scale_;
+    array<double, 4> decay_length_;
+    double core_radius_ = 2;
+    array<SpatialHash2D, 4> secretors_;
+    // secretor positions added by each thread, per substance
+    vector<array<vector<Double3>, 4>> thread_secretors_;
+    array<array<Fit, kCandidates>, 4> fits_;
+    mutex mutex_;
+  };  // end SubstanceField
+
+}  // namespace bdm
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef TELEMETRY_
+#define TELEMETRY_
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace bdm {
+
+  static const uint32_t kTelemetryMagic = 0x4e524554;  // "NRET"
+  static const uint32_t kTelemetryVersion = 1;
+  static const uint32_t kTelemetryMaxTypes = 16;
+  static const uint32_t kTelemetryCapacity = 256;
+  // shared memory segments are named kTelemetryPrefix<seed>_<pid>: runs
+  // with the same seed (concurrent or not) never share a segment
+  static const char* const kTelemetryPrefix = "/new_ret_";
+
+  // one sample published by a running simulation
+  struct TelemetryRecord {
+    uint64_t step;
+    double death_rate;
+    // wall time per simulation step over the last published interval
+    double seconds_per_step;
+    uint32_t type_nb;
+    int32_t types[kTelemetryMaxTypes];
+    double ri[kTelemetryMaxTypes];
+    uint64_t counts[kTelemetryMaxTypes];
+  };
+
+  // Ring buffer slot. The single writer makes sequence odd while it writes
+  // the record, then even again: a reader keeps a copy only if it read the
+  // same even sequence before and after copying (seqlock).
+  struct TelemetrySlot {
+    std::atomic<uint64_t> sequence;
+    TelemetryRecord record;
+  };
+
+  struct TelemetrySegment {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    int32_t seed;
+    std::atomic<uint32_t> finished;
+    // number of records published so far
+    std::atomic<uint64_t> head;
+    TelemetrySlot slots[kTelemetryCapacity];
+  };
+
+  // Publishes telemetry of one simulation in a named POSIX shared memory
+  // segment. Publishing is a copy into the ring buffer: no lock, no system
+  // call, no file I/O. The segment is left after the end of the simulation
+  // (marked finished) so that viewers can read the last records.
+  class TelemetryPublisher {
+   public:
+    explicit TelemetryPublisher(int seed)
+        : name_(std::string(kTelemetryPrefix) + std::to_string(seed) + "_" +
+                std::to_string(getpid())) {
+      // a segment with our name was left by a finished process whose pid was
+      // recycled; never write into a segment another process may still open
+      shm_unlink(name_.c_str());
+      int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+      if (fd == -1) { return; }
+      if (ftruncate(fd, sizeof(TelemetrySegment)) == 0) {
+        void* memory = mmap(nullptr, sizeof(TelemetrySegment),
+                            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory != MAP_FAILED) {
+          segment_ = static_cast<TelemetrySegment*>(memory);
+        }
+      }
+      close(fd);
+      if (!segment_) { return; }
+      segment_->head.store(0, std::memory_order_relaxed);
+      for (auto& slot : segment_->slots) {
+        slot.sequence.store(0, std::memory_order_relaxed);
+      }
+      segment_->pid = getpid();
+      segment_->seed = seed;
+      segment_->version = kTelemetryVersion;
+      segment_->finished.store(0, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      segment_->magic = kTelemetryMagic;
+    }
+
+    ~TelemetryPublisher() {
+      if (segment_) {
+        segment_->finished.store(1, std::memory_order_release);
+        munmap(segment_, sizeof(TelemetrySegment));
+      }
+    }
+
+    TelemetryPublisher(const TelemetryPublisher&) = delete;
+    TelemetryPublisher& operator=(const TelemetryPublisher&) = delete;
+
+    bool IsOpen() const { return segment_ != nullptr; }
+    const std::string& GetName() const { return name_; }
+    static size_t Bytes() { return sizeof(TelemetrySegment); }
+
+    void Publish(const TelemetryRecord& record) {
+      if (!segment_) { return; }
+      uint64_t head = segment_->head.load(std::memory_order_relaxed);
+      auto& slot = segment_->slots[head % kTelemetryCapacity];
+      uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+      slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      std::memcpy(&slot.record, &record, sizeof(TelemetryRecord));
+      slot.sequence.store(sequence + 2, std::memory_order_release);
+      segment_->head.store(head + 1, std::memory_order_release);
+    }
+
+   private:
+    std::string name_;
+    TelemetrySegment* segment_ = nullptr;
+  };  // end TelemetryPublisher
+
+
+  // Read-only view of a telemetry segment, for viewers.
+  class TelemetryReader {
+   public:
+    explicit TelemetryReader(const std::string& name) : name_(name) {
+      int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+      if (fd == -1) { return; }
+      struct stat st;
+      if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(TelemetrySegment)) {
+        void* memory = mmap(nullptr, sizeof(TelemetrySegment), PROT_READ,
+                            MAP_SHARED, fd, 0);
+        if (memory != MAP_FAILED) {
+          segment_ = static_cast<const TelemetrySegment*>(memory);
+          if (segment_->magic != kTelemetryMagic ||
+              segment_->version != kTelemetryVersion) {
+            munmap(const_cast<TelemetrySegment*>(segment_),
+                   sizeof(TelemetrySegment));
+            segment_ = nullptr;
+          }
+        }
+      }
+      close(fd);
+    }
+
+    ~TelemetryReader() {
+      if (segment_) {
+        munmap(const_cast<TelemetrySegment*>(segment_),
+               sizeof(TelemetrySegment));
+      }
+    }
+
+    TelemetryReader(const TelemetryReader&) = delete;
+    TelemetryReader& operator=(const TelemetryReader&) = delete;
+
+    bool IsOpen() const { return segment_ != nullptr; }
+    const std::string& GetName() const { return name_; }
+    int GetSeed() const { return segment_->seed; }
+    int GetPid() const { return segment_->pid; }
+    bool IsFinished() const {
+      return segment_->finished.load(std::memory_order_acquire);
+    }
+    // the publishing process is gone without finishing its simulation
+    bool IsDead() const {
+      return !IsFinished() && kill(segment_->pid, 0) == -1 && errno == ESRCH;
+    }
+
+    uint64_t GetHead() const {
+      return segment_->head.load(std::memory_order_acquire);
+    }
+
+    // copy record number index, false if it was overwritten or is being
+    // written
+    bool Read(uint64_t index, TelemetryRecord* record) const {
+      uint64_t head = GetHead();
+      if (index >= head || head - index > kTelemetryCapacity) { return false; }
+      auto& slot = segment_->slots[index % kTelemetryCapacity];
+      // slot sequence after the write of record index
+      uint64_t expected = 2 * (index / kTelemetryCapacity + 1);
+      uint64_t before = slot.sequence.load(std::memory_order_acquire);
+      if (before != expected) { return false; }
+      std::memcpy(record, &slot.record, sizeof(TelemetryRecord));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return slot.sequence.load(std::memory_order_relaxed) == before;
+    }
+
+    // names of all telemetry segments on this machine
+    static std::vector<std::string> List() {
+      std::vector<std::string> names;
+      std::string prefix = std::string(kTelemetryPrefix).substr(1);
+      if (DIR* dir = opendir("/dev/shm")) {
+        while (struct dirent* entry = readdir(dir)) {
+          std::string file = entry->d_name;
+          if (file.compare(0, prefix.size(), prefix) == 0) {
+            names.push_back("/" + file);
+          }
+        }
+        closedir(dir);
+      }
+      return names;
+    }
+
+   private:
+    std::string name_;
+    const TelemetrySegment* segment_ = nullptr;
+  };  // end TelemetryReader
+
+}  // namespace bdm
+
+#endif
@@ -0,0 +1,337 @@
+#ifndef TILE_COMM_
+#define TILE_COMM_
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bdm {
+
+  // Split of the x-y plane [min, max]^2 into tiles_x * tiles_y tiles, one per
+  // process (rank). The retina is a thin sheet: z is never split.
+  class TileLayout {
+   public:
+    TileLayout(int tiles_x, int tiles_y, double min, double max)
+        : tiles_x_(tiles_x), tiles_y_(tiles_y), min_(min), max_(max) {}
+
+    int GetRankCount() const { return tiles_x_ * tiles_y_; }
+
+    // rank of the tile containing (x, y), points outside are clamped
+    int RankAt(double x, double y) const {
+      return Index(y, tiles_y_) * tiles_x_ + Index(x, tiles_x_);
+    }
+
+    // x0, x1, y0, y1
+    std::vector<double> GetBounds(int rank) const {
+      double width = (max_ - min_) / tiles_x_;
+      double height = (max_ - min_) / tiles_y_;
+      int tx = rank % tiles_x_, ty = rank / tiles_x_;
+      return {min_ + tx * width, min_ + (tx + 1) * width,
+              min_ + ty * height, min_ + (ty + 1) * height};
+    }
+
+    bool Contains(int rank, double x, double y) const {
+      return RankAt(x, y) == rank;
+    }
+
+    // tiles sharing an edge or a corner with rank
+    std::vector<int> Neighbors(int rank) const {
+      std::vector<int> neighbors;
+      int tx = rank % tiles_x_, ty = rank / tiles_x_;
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+          int nx = tx + dx, ny = ty + dy;
+          if ((dx || dy) && nx >= 0 && nx < tiles_x_ && ny >= 0 &&
+              ny < tiles_y_) {
+            neighbors.push_back(ny * tiles_x_ + nx);
+          }
+        }
+      }
+      return neighbors;
+    }
+
+    // (x, y) is closer than halo to the tile of rank
+    bool IsNear(int rank, double x, double y, double halo) const {
+      return IsNear(GetBounds(rank), x, y, halo);
+    }
+
+    // (x, y) is closer than halo to the box b (x0, x1, y0, y1); never true
+    // for an empty box (x0 > x1)
+    static bool IsNear(const std::vector<double>& b, double x, double y,
+                       double halo) {
+      if (b[0] > b[1] || b[2] > b[3]) { return false; }
+      double dx = std::max({b[0] - x, 0.0, x - b[1]});
+      double dy = std::max({b[2] - y, 0.0, y - b[3]});
+      return dx * dx + dy * dy < halo * halo;
+    }
+
+   private:
+    int Index(double v, int n) const {
+      int i = static_cast<int>((v - min_) / (max_ - min_) * n);
+      return std::min(std::max(i, 0), n - 1);
+    }
+
+    int tiles_x_, tiles_y_;
+    double min_, max_;
+  };  // end TileLayout
+
+
+  // Local processes of a decomposed simulation, connected pairwise by Unix
+  // socket pairs created before forking. Messages are length-prefixed byte
+  // buffers; sends and receives of one transfer are multiplexed with poll so
+  // that two processes sending large buffers to each other cannot dead-lock.
+  class ProcessGroup {
+   public:
+    // fork rank_nb - 1 children; every process returns with its own rank
+    static ProcessGroup* Launch(int rank_nb) {
+      static ProcessGroup group;
+      group.size_ = rank_nb;
+      group.sockets_.assign(rank_nb, std::vector<int>(rank_nb, -1));
+      for (int a = 0; a < rank_nb; a++) {
+        for (int b = a + 1; b < rank_nb; b++) {
+          int pair[2];
+          if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+            throw std::runtime_error("socketpair failed");
+          }
+          group.sockets_[a][b] = pair[0];
+          group.sockets_[b][a] = pair[1];
+        }
+      }
+      group.rank_ = 0;
+      for (int r = 1; r < rank_nb; r++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+          throw std::runtime_error("fork failed");
+        }
+        if (pid == 0) {
+          group.rank_ = r;
+          group.children_.clear();
+          break;
+        }
+        group.children_.push_back(pid);
+      }
+      // keep only the sockets of this rank
+      for (int a = 0; a < rank_nb; a++) {
+        for (int b = 0; b < rank_nb; b++) {
+          if (a != group.rank_ && group.sockets_[a][b] != -1) {
+            close(group.sockets_[a][b]);
+            group.sockets_[a][b] = -1;
+          }
+        }
+      }
+      return &group;
+    }
+
+    int GetRank() const { return rank_; }
+    int GetSize() const { return size_; }
+
+    // send outgoing[peer] to every peer of outgoing and receive one buffer
+    // from every rank of incoming_peers
+    std::map<int, std::vector<char>> Transfer(
+        const std::map<int, std::vector<char>>& outgoing,
+        const std::vector<int>& incoming_peers) {
+      struct Channel {
+        int fd;
+        // outgoing: size header then payload
+        uint64_t send_size;
+        const std::vector<char>* send_buffer;
+        size_t sent;
+        bool sending;
+        // incoming
+        uint64_t recv_size;
+        std::vector<char>* recv_buffer;
+        size_t received;
+        bool receiving;
+      };
+      std::map<int, std::vector<char>> incoming;
+      std::map<int, Channel> channels;
+      for (auto& out : outgoing) {
+        auto& channel = GetChannel(&channels, out.first);
+        channel.send_size = out.second.size();
+        channel.send_buffer = &out.second;
+        channel.sending = true;
+      }
+      for (int peer : incoming_peers) {
+        auto& channel = GetChannel(&channels, peer);
+        channel.recv_buffer = &incoming[peer];
+        channel.receiving = true;
+      }
+
+      while (true) {
+        std::vector<pollfd> fds;
+        std::vector<Channel*> polled;
+        for (auto& c : channels) {
+          short events = (c.second.sending ? POLLOUT : 0) |
+                         (c.second.receiving ? POLLIN : 0);
+          if (events) {
+            fds.push_back({c.second.fd, events, 0});
+            polled.push_back(&c.second);
+          }
+        }
+        if (fds.empty()) { break; }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+          if (errno == EINTR) { continue; }
+          throw std::runtime_error("poll failed");
+        }
+        for (size_t i = 0; i < fds.size(); i++) {
+          auto* c = polled[i];
+          if (c->sending && (fds[i].revents & POLLOUT)) {
+            Send(c);
+          }
+          if (c->receiving && (fds[i].revents & (POLLIN | POLLHUP))) {
+            Receive(c);
+          }
+          if (fds[i].revents & POLLERR) {
+            throw std::runtime_error("peer process failed");
+          }
+        }
+      }
+      return incoming;
+    }
+
+    // same number of values on every rank, summed over all ranks
+    std::vector<double> AllReduceSum(const std::vector<double>& values) {
+      std::vector<double> sum = values;
+      std::vector<int> children;
+      for (int r = 1; r < size_; r++) {
+        children.push_back(r);
+      }
+      if (rank_ == 0) {
+        auto gathered = Transfer({}, children);
+        for (auto& message : gathered) {
+          auto* v = reinterpret_cast<const double*>(message.second.data());
+          for (size_t i = 0; i < sum.size(); i++) {
+            sum[i] += v[i];
+          }
+        }
+        std::vector<char> buffer(sum.size() * sizeof(double));
+        memcpy(buffer.data(), sum.data(), buffer.size());
+        std::map<int, std::vector<char>> outgoing;
+        for (int r : children) {
+          outgoing[r] = buffer;
+        }
+        Transfer(outgoing, {});
+      } else {
+        std::vector<char> buffer(values.size() * sizeof(double));
+        memcpy(buffer.data(), values.data(), buffer.size());
+        Transfer({{0, buffer}}, {});
+        auto result = Transfer({}, {0});
+        memcpy(sum.data(), result[0].data(), result[0].size());
+      }
+      return sum;
+    }
+
+    // rank 0 waits for the other processes
+    void Finalize() {
+      for (pid_t pid : children_) {
+        int status;
+        waitpid(pid, &status, 0);
+      }
+      children_.clear();
+    }
+
+   private:
+    template <typename TChannel>
+    TChannel& GetChannel(std::map<int, TChannel>* channels, int peer) {
+      auto it = channels->find(peer);
+      if (it == channels->end()) {
+        TChannel channel;
+        memset(&channel, 0, sizeof(TChannel));
+        channel.fd = sockets_[rank_][peer];
+        it = channels->insert({peer, channel}).first;
+      }
+      return it->second;
+    }
+
+    template <typename TChannel>
+    void Send(TChannel* c) {
+      const char* data;
+      size_t remaining;
+      if (c->sent < sizeof(uint64_t)) {
+        data = reinterpret_cast<const char*>(&c->send_size) + c->sent;
+        remaining = sizeof(uint64_t) - c->sent;
+      } else {
+        size_t offset = c->sent - sizeof(uint64_t);
+        data = c->send_buffer->data() + offset;
+        remaining = c->send_buffer->size() - offset;
+      }
+      ssize_t n = send(c->fd, data, remaining, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+          return;
+        }
+        throw std::runtime_error("send to peer process failed");
+      }
+      c->sent += n;
+      if (c->sent == sizeof(uint64_t) + c->send_buffer->size()) {
+        c->sending = false;
+      }
+    }
+
+    template <typename TChannel>
+    void Receive(TChannel* c) {
+      char* data;
+      size_t remaining;
+      if (c->received < sizeof(uint64_t)) {
+        data = reinterpret_cast<char*>(&c->recv_size) + c->received;
+        remaining = sizeof(uint64_t) - c->received;
+      } else {
+        size_t offset = c->received - sizeof(uint64_t);
+        data = c->recv_buffer->data() + offset;
+        remaining = c->recv_buffer->size() - offset;
+      }
+      ssize_t n = remaining == 0 ? 0 : recv(c->fd, data, remaining, MSG_DONTWAIT);
+      if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+          return;
+        }
+        throw std::runtime_error("receive from peer process failed");
+      }
+      if (n == 0 && remaining != 0) {
+        throw std::runtime_error("peer process exited");
+      }
+      c->received += n;
+      if (c->received == sizeof(uint64_t)) {
+        c->recv_buffer->resize(c->recv_size);
+      }
+      if (c->received >= sizeof(uint64_t) &&
+          c->received == sizeof(uint64_t) + c->recv_size) {
+        c->receiving = false;
+      }
+    }
+
+    int rank_ = 0;
+    int size_ = 1;
+    std::vector<std::vector<int>> sockets_;
+    std::vector<pid_t> children_;
+  };  // end ProcessGroup
+
+
+  // append / read plain data in exchange buffers
+  template <typename T>
+  inline void AppendRecord(std::vector<char>* buffer, const T& record) {
+    const char* bytes = reinterpret_cast<const char*>(&record);
+    buffer->insert(buffer->end(), bytes, bytes + sizeof(T));
+  }
+
+  template <typename T>
+  inline T ReadRecord(const std::vector<char>& buffer, size_t* offset) {
+    T record;
+    memcpy(&record, buffer.data() + *offset, sizeof(T));
+    *offset += sizeof(T);
+    return record;
+  }
+
+}  // namespace bdm
+
+#endif
@@ -1,38 +1,83 @@
 #ifndef UTILS_METHODS
 #define UTILS_METHODS
 
+#include <functional>
+#include "arbor.h"
+#include "cell_placement.h"
 #include "extended_objects.h"
 #include "rgc_soma_bm.h"
 #include "rgc_dendrite_bm.h"
+#include "telemetry.h"
 
 namespace bdm {
   using namespace std;
 
   // define my cell creator
-  static void CellCreator(double min, double max, int num_cells, int cell_type) {
+  // Positions are drawn in parallel (cell_placement.h, seeded from the
+  // simulation random generator), then cells are allocated serially (uids
+  // stay in creation order) and given their modules in parallel. Only cells
+  // at positions accepted by keep are created: processes of a decomposed
+  // simulation draw the same cells and keep those of their tile.
+  static void CellCreator(double min, double max, int num_cells, int cell_type,
+                          const function<bool(const Double3&)>& keep = nullptr) {
     auto* sim = Simulation::GetActive();
     auto* rm = sim->GetResourceManager();
     auto* random = sim->GetRandom();
 
+    uint64_t base_seed = (uint64_t)random->Uniform(0, 4294967296.0);
+    auto placement = DrawCellPlacement(base_seed, min, max, num_cells);
+    vector<Double3> positions(num_cells);
     for (int i = 0; i < num_cells; i++) {
-      double x = random->Uniform(min + 10, max - 10);
-      double y = random->Uniform(min + 10, max - 10);
-      // RGCL thickness before cell death ~24
-      double z = random->Uniform(min + 20, min + 34);
+      auto& p = placement.positions[i];
+      positions[i] = {p[0], p[1], p[2]};
+    }
+    auto& diameters = placement.diameters;
+
+    vector<int> kept;
+    for (int i = 0; i < num_cells; i++) {
+      if (!keep || keep(positions[i])) {
+        kept.push_back(i);
+      }
+    }
+    vector<MyCell*> cells(kept.size());
+    for (auto& cell : cells) {
+      cell = new MyCell();
+    }
 
-      MyCell* cell = new MyCell({x, y, z});
-      cell->SetDiameter(random->Uniform(7, 8));
+#pragma omp parallel for
+    for (size_t k = 0; k < kept.size(); k++) {
+      MyCell* cell = cells[k];
+      cell->SetPosition(positions[kept[k]]);
+      cell->SetDiameter(diameters[kept[k]]);
       cell->SetCellType(cell_type);
-      cell->SetPreviousPosition({x, y, z});
+      cell->SetPreviousPosition(positions[kept[k]]);
       cell->AddBiologyModule(new Substance_secretion_BM());
       cell->AddBiologyModule(new RGC_mosaic_BM());
       cell->AddBiologyModule(new Internal_clock_BM());
       cell->AddBiologyModule(new Dendrite_creation_BM());
+    }
+
+    rm->Reserve(rm->GetNumSimObjects() + cells.size());
+    for (auto* cell : cells) {
       rm->push_back(cell);
     }
   }  // end CellCreator
 
 
+  // run steps simulation steps; the indexes read by modules and mechanics
+  // are rebuilt before each one (step_index.h)
+  inline void SimulateSteps(Scheduler* scheduler, int steps) {
+    // indexes register when created
+    SubstanceField::Get();
+    DendriteSegmentHash::Get();
+    MonolayerMechanics::Get();
+    for (int step = 0; step < steps; step++) {
+      StepIndex::UpdateAll();
+      scheduler->Simulate(1);
+    }
+  }  // end SimulateSteps
+
+
   inline void WritePositions(int i, int seed) {
     auto* sim = Simulation::GetActive();
     auto* rm = sim->GetResourceManager();
@@ -58,48 +103,6 @@ namespace bdm {
   } // end WritePositions
 
 
-  template <typename T>
-  inline string SwcNeurites(T ne_so_ptr, int label_parent,
-                            const Double3& soma_position) {
-    auto* ne = static_cast<MyNeurite*>(&*ne_so_ptr);
-    Double3 ne_position = ne->GetPosition();
-    ne_position[0] = ne_position[0] - soma_position[0];
-    ne_position[1] = ne_position[1] - soma_position[1];
-    ne_position[2] = ne_position[2] - soma_position[2];
-    double radius = ne->GetDiameter() / 2;
-    string temps;
-
-    ne->GetMySoma()->IncreaseLabel();
-    // set explicitly the value of GetLabel() to avoid reference
-    int current_label = ne->GetMySoma()->GetLabel();
-
-    // if branching point
-    if (ne->GetDaughterRight() != nullptr) {
-      temps = Concat(temps, "\n", current_label, " 3 ", ne_position[0], " ",
-                ne_position[1], " ", ne_position[2], " ", radius, " ", label_parent,
-                SwcNeurites(ne->GetDaughterRight(), current_label, soma_position))
-              .c_str();
-      ne->GetMySoma()->IncreaseLabel();
-    }
-    // if straigh dendrite
-    current_label = ne->GetMySoma()->GetLabel();
-    if (ne->GetDaughterLeft() != nullptr) {
-      temps = Concat(temps, "\n", current_label, " 3 ", ne_position[0], " ",
-                ne_position[1], " ", ne_position[2], " ", radius, " ", label_parent,
-                SwcNeurites(ne->GetDaughterLeft(), current_label, soma_position))
-              .c_str();
-    }
-    // if ending point
-    if (ne->GetDaughterLeft() == nullptr && ne->GetDaughterRight() == nullptr) {
-      temps = Concat(temps, "\n", current_label, " 6 ", ne_position[0], " ",
-                ne_position[1], " ", ne_position[2], " ", radius, " ", label_parent)
-              .c_str();
-    }
-
-    return temps;
-  } // end SwcNeurites
-
-
   inline void WriteSwc(int i, int seed) {
     auto* sim = Simulation::GetActive();
     auto* rm = sim->GetResourceManager();
@@ -108,27 +111,39 @@ namespace bdm {
     rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
       auto* cell = dynamic_cast<MyCell*>(so);
       if (cell) {
-        int cell_type = cell->GetCellType();
-        auto cell_position = cell->GetPosition();
-        ofstream swc_file;
         string swc_fileName = Concat(param->output_dir_,
           "/results", seed, "/swc_files/cell", cell->GetUid(),
-          "_type", cell_type, "_seed", seed, "_step", i, ".swc").c_str();
-        swc_file.open(swc_fileName);
-        cell->SetLabel(1);
-        swc_file << cell->GetLabel() << " 1 0 0 0 " << cell->GetDiameter() / 2
-                 << " -1";
-
-        for (auto& ne : cell->GetDaughters()) {
-          swc_file << SwcNeurites(ne, 1, cell_position);
-        }
-        swc_file.close();
+          "_type", cell->GetCellType(), "_seed", seed, "_step", i, ".swc").c_str();
+        WriteArborSwc(BuildArbor(cell), swc_fileName);
       }
     });  // end for cell in simulation
 
   } // end WriteSwc
 
 
+  inline void WriteMorphometrics(int i, int seed) {
+    auto* sim = Simulation::GetActive();
+    auto* rm = sim->GetResourceManager();
+    auto* param = sim->GetParam();
+    ofstream morpho_file(Concat(param->output_dir_, "/results", seed,
+                                "/morphometrics_", seed, "_step", i, ".txt"));
+
+    rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
+      auto* cell = dynamic_cast<MyCell*>(so);
+      if (cell) {
+        Arbor arbor = BuildArbor(cell);
+        // uid type length branch_points terminals field_area strahler
+        morpho_file << cell->GetUid() << " " << arbor.cell_type << " "
+                    << arbor.TotalLength() << " " << arbor.BranchPoints()
+                    << " " << arbor.Terminals() << " " << arbor.FieldArea()
+                    << " " << arbor.StrahlerOrder() << "\n";
+      }
+    });  // end for cell in simulation
+
+    morpho_file.close();
+  } // end WriteMorphometrics
+
+
   // RI computation
   inline double ComputeRi(vector<Double3> coord_list) {
     if (coord_list.size() < 2) {
@@ -217,6 +232,45 @@ namespace bdm {
   }
 
 
+  // counts of the types of all_ri are taken from the simulation if not given
+  inline void PublishTelemetry(TelemetryPublisher* telemetry, int step,
+                               const vector<array<double, 2>>& all_ri,
+                               double death_rate, double seconds_per_step,
+                               const vector<uint64_t>& counts = {}) {
+    auto* sim = Simulation::GetActive();
+    auto* rm = sim->GetResourceManager();
+    TelemetryRecord record;
+    memset(&record, 0, sizeof(TelemetryRecord));
+    record.step = step;
+    record.death_rate = death_rate;
+    record.seconds_per_step = seconds_per_step;
+    record.type_nb = min<size_t>(all_ri.size(), kTelemetryMaxTypes);
+    for (uint32_t t = 0; t < record.type_nb; t++) {
+      record.ri[t] = all_ri[t][0];
+      record.types[t] = all_ri[t][1];
+    }
+    if (!counts.empty()) {
+      for (uint32_t t = 0; t < record.type_nb; t++) {
+        record.counts[t] = counts[t];
+      }
+      telemetry->Publish(record);
+      return;
+    }
+    rm->ApplyOnAllElements([&](SimObject* so, SoHandle) {
+      auto* cell = dynamic_cast<MyCell*>(so);
+      if (cell) {
+        for (uint32_t t = 0; t < record.type_nb; t++) {
+          if (record.types[t] == cell->GetCellType()) {
+            record.counts[t]++;
+            break;
+          }
+        }
+      }
+    });  // end for cell in simulation
+    telemetry->Publish(record);
+  } // end PublishTelemetry
+
+
   inline double GetDeathRate(int num_cells) {
     auto* sim = Simulation::GetActive();
     auto* rm = sim->GetResourceManager();
@@ -0,0 +1,158 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) The BioDynaMo Project.
+// All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+//
+// Check of the mosaic measures (delaunay.h, mosaic_measures.h):
+// - Delaunay2D: the nearest neighbour of every point is one of its Delaunay
+//   neighbours (against brute force, random points)
+// - Voronoi areas, DRP, effective radius and packing factor of a hexagonal
+//   lattice, whose values are known
+// - DRP of a mosaic without any cell far enough from its border
+//   new_ret_mosaic_check         exit code 0 if every check passed
+//
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "delaunay.h"
+#include "mosaic_measures.h"
+
+using bdm::Delaunay2D;
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+  if (!condition) {
+    fprintf(stderr, "%s failed\n", what);
+    failures++;
+  }
+}
+
+static bool Near(double a, double b, double tolerance = 1e-9) {
+  return std::fabs(a - b) <= tolerance * std::max(1.0, std::fabs(b));
+}
+
+static void CheckNearestNeighbors() {
+  std::mt19937_64 random(42);
+  std::uniform_real_distribution<double> uniform(0, 1000);
+  const size_t n = 5000;
+  std::vector<double> x(n), y(n);
+  for (size_t i = 0; i < n; i++) {
+    x[i] = uniform(random);
+    y[i] = uniform(random);
+  }
+  Delaunay2D delaunay;
+  delaunay.Triangulate(x, y);
+  size_t wrong = 0;
+  for (size_t i = 0; i < n; i++) {
+    double nearest = INFINITY;
+    for (size_t j = 0; j < n; j++) {
+      if (j != i) {
+        nearest = std::min(nearest, std::hypot(x[j] - x[i], y[j] - y[i]));
+      }
+    }
+    double nearest_neighbor = INFINITY;
+    delaunay.ForEachNeighbor(i, [&](uint32_t j) {
+      if (j < n) {
+        nearest_neighbor =
+            std::min(nearest_neighbor, std::hypot(x[j] - x[i], y[j] - y[i]));
+      }
+    });
+    wrong += nearest_neighbor != nearest;
+  }
+  Check(wrong == 0, "Delaunay nearest neighbours");
+}
+
+// rows x columns cells at distance spacing from their 6 neighbours
+static void HexagonalLattice(int rows, int columns, double spacing,
+                             std::vector<double>* x, std::vector<double>* y) {
+  for (int r = 0; r < rows; r++) {
+    for (int c = 0; c < columns; c++) {
+      x->push_back((c + (r % 2) * 0.5) * spacing);
+      y->push_back(r * spacing * std::sqrt(3) / 2);
+    }
+  }
+}
+
+static void CheckHexagonalLattice() {
+  const double spacing = 10;
+  const int rows = 40, columns = 40;
+  std::vector<double> x, y;
+  HexagonalLattice(rows, columns, spacing, &x, &y);
+  size_t n = x.size();
+  double cell_area = std::sqrt(3) / 2 * spacing * spacing;
+
+  Delaunay2D delaunay;
+  delaunay.Triangulate(x, y);
+  size_t closed = 0, wrong_area = 0;
+  for (size_t i = 0; i < n; i++) {
+    double area = delaunay.VoronoiArea(i);
+    if (area > 0) {
+      closed++;
+      wrong_area += !Near(area, cell_area, 1e-6);
+    }
+  }
+  // cells of the outer ring may have unbounded domains
+  Check(closed >= (size_t)(rows - 2) * (columns - 2), "closed Voronoi domains");
+  Check(wrong_area == 0, "Voronoi areas of a hexagonal lattice");
+
+  // neighbours at 10.5 bin widths: bins 0 to 9 are empty, bin 10 holds the
+  // 6 neighbours of every reference cell
+  double bin_width = spacing / 10.5;
+  auto stats = bdm::ComputeMosaicStats(x, y, n * cell_area, 20, bin_width);
+  Check(Near(stats.density, 1 / cell_area), "lattice density");
+  bool empty = true;
+  for (int b = 0; b < 10; b++) {
+    empty &= stats.drp[b] == 0;
+  }
+  Check(empty, "empty DRP bins under the lattice spacing");
+  double annulus = M_PI * bin_width * bin_width * 21;
+  Check(Near(stats.drp[10], 6 / annulus), "DRP of the nearest neighbours");
+  // empty disk of the 10 empty bins, in a mosaic whose hexagonal packing
+  // radius is the spacing
+  Check(Near(stats.effective_radius, 10 * bin_width), "effective radius");
+  Check(Near(stats.packing_factor, std::pow(10 / 10.5, 2)), "packing factor");
+  Check(Near(stats.voronoi_mean_area, cell_area, 1e-6), "Voronoi mean area");
+}
+
+// cells along the border of a wide square only: no cell is far enough from
+// the border to be a DRP reference, all cells are used
+static void CheckBorderOnlyMosaic() {
+  std::vector<double> x, y;
+  for (int i = 0; i < 100; i++) {
+    x.push_back(i * 3);    y.push_back(0);
+    x.push_back(i * 3);    y.push_back(300);
+    x.push_back(0);        y.push_back(i * 3 + 1.5);
+    x.push_back(300);      y.push_back(i * 3 + 1.5);
+  }
+  auto stats = bdm::ComputeMosaicStats(x, y, 300 * 300, 20, 3);
+  bool finite = !stats.drp.empty();
+  for (double d : stats.drp) {
+    finite &= std::isfinite(d);
+  }
+  Check(finite, "DRP without reference cell far from the border");
+  Check(std::isfinite(stats.effective_radius),
+        "effective radius without reference cell far from the border");
+}
+
+int main() {
+  CheckNearestNeighbors();
+  CheckHexagonalLattice();
+  CheckBorderOnlyMosaic();
+  if (failures != 0) {
+    printf("%d mosaic check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all mosaic checks passed\n");
+  return 0;
+}
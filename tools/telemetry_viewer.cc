@@ -0,0 +1,157 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) The BioDynaMo Project.
+// All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+//
+// Viewer for the telemetry published by running new_ret simulations.
+//   new_ret_telemetry            latest record of every simulation
+//   new_ret_telemetry <seed>     follow one simulation until it finishes;
+//                                if several have this seed, the running one
+//   new_ret_telemetry <seed>_<pid>  follow the simulation of process pid
+//   new_ret_telemetry --clean    remove segments of finished simulations
+//
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "telemetry.h"
+
+using bdm::TelemetryReader;
+using bdm::TelemetryRecord;
+
+static const char* Status(const TelemetryReader& reader) {
+  if (reader.IsFinished()) { return "finished"; }
+  return reader.IsDead() ? "dead" : "running";
+}
+
+static void PrintRecord(const TelemetryRecord& record) {
+  printf("step %6lu  death %5.1f%%  %8.4f s/step ",
+         (unsigned long)record.step, record.death_rate,
+         record.seconds_per_step);
+  for (uint32_t t = 0; t < record.type_nb && t < bdm::kTelemetryMaxTypes;
+       t++) {
+    printf(" | %d: %lu cells ri %.2f", record.types[t],
+           (unsigned long)record.counts[t], record.ri[t]);
+  }
+  printf("\n");
+}
+
+static int ListAll() {
+  auto names = TelemetryReader::List();
+  if (names.empty()) {
+    printf("no running simulation\n");
+  }
+  for (auto& name : names) {
+    TelemetryReader reader(name);
+    if (!reader.IsOpen()) { continue; }
+    printf("seed %5d pid %7d %-8s ", reader.GetSeed(), reader.GetPid(),
+           Status(reader));
+    TelemetryRecord record;
+    uint64_t head = reader.GetHead();
+    if (head != 0 && reader.Read(head - 1, &record)) {
+      PrintRecord(record);
+    } else {
+      printf("no record yet\n");
+    }
+  }
+  return 0;
+}
+
+// segment of <seed>_<pid>, or of <seed> if only one of its simulations is
+// running (or only one exists); empty otherwise, with the candidates printed
+static std::string FindSegment(const std::string& id) {
+  if (id.find('_') != std::string::npos) {
+    return bdm::kTelemetryPrefix + id;
+  }
+  std::string prefix = bdm::kTelemetryPrefix + id + "_";
+  std::vector<std::string> all, running;
+  for (auto& name : TelemetryReader::List()) {
+    if (name.compare(0, prefix.size(), prefix) != 0) { continue; }
+    TelemetryReader reader(name);
+    if (!reader.IsOpen()) { continue; }
+    all.push_back(name);
+    if (!reader.IsFinished() && !reader.IsDead()) {
+      running.push_back(name);
+    }
+  }
+  if (running.size() == 1) { return running[0]; }
+  if (running.empty() && all.size() == 1) { return all[0]; }
+  if (all.empty()) {
+    fprintf(stderr, "no telemetry for seed %s\n", id.c_str());
+  } else {
+    fprintf(stderr, "several simulations with seed %s, use <seed>_<pid>:\n",
+            id.c_str());
+    for (auto& name : running.empty() ? all : running) {
+      TelemetryReader reader(name);
+      fprintf(stderr, "  %s_%d %s\n", id.c_str(), reader.GetPid(),
+              Status(reader));
+    }
+  }
+  return "";
+}
+
+static int Follow(const std::string& id) {
+  std::string name = FindSegment(id);
+  if (name.empty()) { return 1; }
+  TelemetryReader reader(name);
+  if (!reader.IsOpen()) {
+    fprintf(stderr, "no telemetry for %s\n", id.c_str());
+    return 1;
+  }
+  uint64_t next = 0;
+  while (true) {
+    uint64_t head = reader.GetHead();
+    if (head - next > bdm::kTelemetryCapacity) {
+      next = head - bdm::kTelemetryCapacity;
+    }
+    for (; next < head; next++) {
+      TelemetryRecord record;
+      if (reader.Read(next, &record)) {
+        PrintRecord(record);
+      }
+    }
+    fflush(stdout);
+    if (reader.IsFinished() || reader.IsDead()) {
+      printf("simulation %s\n", Status(reader));
+      return 0;
+    }
+    usleep(200000);
+  }
+}
+
+static int Clean() {
+  for (auto& name : TelemetryReader::List()) {
+    bool finished;
+    {
+      // a segment without valid header may be one being created
+      TelemetryReader reader(name);
+      finished = reader.IsOpen() && (reader.IsFinished() || reader.IsDead());
+    }
+    if (finished && shm_unlink(name.c_str()) == 0) {
+      printf("removed %s\n", name.c_str());
+    }
+  }
+  return 0;
+}
+
+int main(int argc, const char** argv) {
+  if (argc < 2) {
+    return ListAll();
+  }
+  if (strcmp(argv[1], "--clean") == 0) {
+    return Clean();
+  }
+  return Follow(argv[1]);
+}
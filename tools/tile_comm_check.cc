@@ -0,0 +1,172 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) The BioDynaMo Project.
+// All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+//
+// Check of the multi-process layer of tiled simulations (tile_comm.h), run on
+// 2x2 local processes:
+// - TileLayout: ranks, bounds, neighbours and halo tests
+// - ProcessGroup::Transfer: sizes and contents of the buffers received from
+//   every neighbour, empty and multi-megabyte ones included
+// - ProcessGroup::AllReduceSum
+// - cell creation: tiles keeping the cells of the common placement
+//   (cell_placement.h) have the cell count and the death rate at step 0 of
+//   the untiled simulation
+// Every rank checks its part; failures are summed and rank 0 reports them.
+//   new_ret_tile_check           exit code 0 if every check passed
+//
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <vector>
+#include "cell_placement.h"
+#include "tile_comm.h"
+
+using bdm::ProcessGroup;
+using bdm::TileLayout;
+
+static const int kTilesX = 2;
+static const int kTilesY = 2;
+// bounds and cell number of Simulate
+static const double kMin = 0;
+static const double kMax = 1020;
+static const int kNumCells = 986;
+
+static int failures = 0;
+
+static void Check(bool condition, int rank, const char* what) {
+  if (!condition) {
+    fprintf(stderr, "rank %d: %s failed\n", rank, what);
+    failures++;
+  }
+}
+
+static void CheckLayout(const TileLayout& layout, int rank) {
+  auto b = layout.GetBounds(rank);
+  double x = (b[0] + b[1]) / 2, y = (b[2] + b[3]) / 2;
+  Check(layout.RankAt(x, y) == rank, rank, "RankAt of tile centre");
+  Check(layout.Contains(rank, b[0], b[2]), rank, "Contains of tile corner");
+  // points outside of the domain belong to the closest tile
+  Check(layout.RankAt(b[0] < kMax / 2 ? -5 : kMax + 5,
+                      b[2] < kMax / 2 ? -5 : kMax + 5) == rank,
+        rank, "RankAt clamping");
+  auto neighbors = layout.Neighbors(rank);
+  Check(neighbors.size() == 3, rank, "Neighbors in 2x2 tiles");
+  for (int n : neighbors) {
+    Check(n != rank && n >= 0 && n < layout.GetRankCount(), rank,
+          "Neighbors rank range");
+    Check(!layout.IsNear(n, x, y, 10), rank, "IsNear of distant point");
+    auto nb = layout.GetBounds(n);
+    Check(layout.IsNear(n, (b[0] + b[1]) / 2 + (nb[0] - b[0]) / 2 * 1.01,
+                        (b[2] + b[3]) / 2 + (nb[2] - b[2]) / 2 * 1.01, 20),
+          rank, "IsNear of point close to neighbour");
+  }
+  double inf = std::numeric_limits<double>::infinity();
+  Check(!TileLayout::IsNear({inf, -inf, inf, -inf}, x, y, 1e9), rank,
+        "IsNear of empty box");
+  Check(TileLayout::IsNear({0, 10, 0, 10}, 15, 5, 6), rank, "IsNear of box");
+  Check(!TileLayout::IsNear({0, 10, 0, 10}, 15, 15, 6), rank,
+        "IsNear of box corner");
+}
+
+// size of the buffer sent from rank from to rank to at iteration: empty for
+// some pairs, up to several megabytes for others
+static size_t BufferSize(int from, int to, int iteration) {
+  if ((from + to + iteration) % 5 == 0) { return 0; }
+  return (size_t)(from * 1000003 + to * 7919 + iteration * 104729) % 3000000;
+}
+
+static void CheckTransfer(ProcessGroup* group, const TileLayout& layout,
+                          int rank) {
+  auto neighbors = layout.Neighbors(rank);
+  for (int iteration = 0; iteration < 20; iteration++) {
+    std::map<int, std::vector<char>> outgoing;
+    for (int n : neighbors) {
+      outgoing[n].assign(BufferSize(rank, n, iteration),
+                         (char)(rank + iteration));
+    }
+    auto incoming = group->Transfer(outgoing, neighbors);
+    Check(incoming.size() == neighbors.size(), rank,
+          "Transfer from every neighbour");
+    for (auto& message : incoming) {
+      Check(message.second.size() == BufferSize(message.first, rank, iteration),
+            rank, "Transfer buffer size");
+      bool content = true;
+      for (char c : message.second) {
+        content &= c == (char)(message.first + iteration);
+      }
+      Check(content, rank, "Transfer buffer content");
+    }
+  }
+}
+
+static void CheckAllReduceSum(ProcessGroup* group, int rank) {
+  int size = group->GetSize();
+  auto sum = group->AllReduceSum({(double)rank, 1.0, 0.5});
+  Check(sum.size() == 3 && sum[0] == size * (size - 1) / 2 && sum[1] == size &&
+            sum[2] == size * 0.5,
+        rank, "AllReduceSum");
+}
+
+// as DomainDecomposition::GetDeathRate at step 0
+static double DeathRate(double cell_in_simu, int num_cells) {
+  return (1 - (cell_in_simu / num_cells)) * 100;
+}
+
+static void CheckCellCreation(ProcessGroup* group, const TileLayout& layout,
+                              int rank) {
+  // every tile draws the cells of the untiled simulation and keeps its own,
+  // as in Simulate
+  auto placement = bdm::DrawCellPlacement(12345, kMin, kMax, kNumCells);
+  double kept = 0, sum_x = 0, sum_y = 0;
+  for (auto& p : placement.positions) {
+    if (layout.Contains(rank, p[0], p[1])) {
+      kept++;
+      sum_x += p[0];
+      sum_y += p[1];
+    }
+  }
+  auto sums = group->AllReduceSum({kept, sum_x, sum_y});
+  double untiled_x = 0, untiled_y = 0;
+  for (auto& p : placement.positions) {
+    untiled_x += p[0];
+    untiled_y += p[1];
+  }
+  Check(sums[0] == kNumCells, rank, "tiled cell count");
+  Check(DeathRate(sums[0], kNumCells) == DeathRate(kNumCells, kNumCells), rank,
+        "tiled death rate at step 0");
+  Check(std::fabs(sums[1] - untiled_x) < 1e-6 * untiled_x &&
+            std::fabs(sums[2] - untiled_y) < 1e-6 * untiled_y,
+        rank, "tiled cell positions");
+}
+
+int main() {
+  TileLayout layout(kTilesX, kTilesY, kMin, kMax);
+  auto* group = ProcessGroup::Launch(layout.GetRankCount());
+  int rank = group->GetRank();
+
+  CheckLayout(layout, rank);
+  CheckTransfer(group, layout, rank);
+  CheckAllReduceSum(group, rank);
+  CheckCellCreation(group, layout, rank);
+
+  int total = (int)group->AllReduceSum({(double)failures})[0];
+  group->Finalize();
+  if (rank != 0) { return 0; }
+  if (total != 0) {
+    printf("%d tile check(s) failed\n", total);
+    return 1;
+  }
+  printf("all tile checks passed on %d processes\n", layout.GetRankCount());
+  return 0;
+}